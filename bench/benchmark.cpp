@@ -0,0 +1,446 @@
+#include "benchmark.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "binner.hpp"
+#include "geometry.hpp"
+#include "profile.hpp"
+#include "simd.hpp"
+
+extern Isa rasterIsa;
+
+namespace bench
+{
+
+namespace
+{
+
+struct Benchmark
+{
+    std::string name;
+    std::function<void(State&)> function;
+};
+
+std::vector<Benchmark> registry;
+
+struct Run
+{
+    long long iterations;
+    double real;
+    double cpu;
+};
+
+struct Result
+{
+    std::string name;
+    std::string error;
+    double items;
+    double bytes;
+    std::vector<Run> runs;
+};
+
+// Runs function once for the given number of iterations; the times are per
+// iteration. What the code under test logs is dropped; failures are
+// reported through State::skipWithError.
+Run measure(const Benchmark& benchmark, const long long iterations,
+            State& state)
+{
+    std::streambuf* const log{std::cerr.rdbuf(nullptr)};
+    benchmark.function(state);
+    std::cerr.rdbuf(log);
+    std::cerr.clear();
+    const double n{static_cast<double>(std::max(1LL, iterations))};
+    return {iterations, state.realSeconds / n, state.cpuSeconds / n};
+}
+
+// Grows the iteration count until one run takes minTime, as Google
+// Benchmark does, then measures repetitions runs of that many iterations.
+Result run(const Benchmark& benchmark, const double minTime,
+           const int repetitions)
+{
+    constexpr long long maxIterations{1'000'000'000};
+    Result result{benchmark.name, {}, 0, 0, {}};
+    long long iterations{1};
+
+    for (;;)
+    {
+        State state(iterations);
+        measure(benchmark, iterations, state);
+
+        if (!state.error.empty())
+        {
+            result.error = state.error;
+            return result;
+        }
+
+        if (state.realSeconds >= minTime || iterations >= maxIterations)
+            break;
+
+        // Aim past minTime, but only trust the estimate of a run long
+        // enough for the clock.
+        const double seconds{std::max(state.realSeconds, 1e-9)};
+        const double grow{seconds / minTime > 0.1 ? minTime * 1.4 / seconds
+                                                  : 10.0};
+        iterations = std::min(
+            maxIterations,
+            std::max(iterations + 1,
+                     static_cast<long long>(std::ceil(iterations * grow))));
+    }
+
+    for (int rep{0}; rep < repetitions; ++rep)
+    {
+        State state(iterations);
+        result.runs.push_back(measure(benchmark, iterations, state));
+        result.items = state.items;
+        result.bytes = state.bytes;
+    }
+
+    return result;
+}
+
+double median(std::vector<double> values)
+{
+    std::sort(values.begin(), values.end());
+    const std::size_t n{values.size()};
+    return n % 2 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2;
+}
+
+double mean(const std::vector<double>& values)
+{
+    double sum{0};
+
+    for (double v : values) sum += v;
+
+    return sum / values.size();
+}
+
+double stddev(const std::vector<double>& values)
+{
+    if (values.size() < 2)
+        return 0;
+
+    const double m{mean(values)};
+    double sum{0};
+
+    for (double v : values) sum += (v - m) * (v - m);
+
+    return std::sqrt(sum / (values.size() - 1));
+}
+
+std::string formatTime(const double seconds)
+{
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(seconds < 1e-6 ? 2 : 3);
+
+    if (seconds < 1e-6)
+        out << seconds * 1e9 << " ns";
+    else if (seconds < 1e-3)
+        out << seconds * 1e6 << " us";
+    else
+        out << seconds * 1e3 << " ms";
+
+    return out.str();
+}
+
+std::string formatRate(const double rate, const char* unit)
+{
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(2);
+
+    if (rate >= 1e9)
+        out << rate / 1e9 << " G";
+    else if (rate >= 1e6)
+        out << rate / 1e6 << " M";
+    else if (rate >= 1e3)
+        out << rate / 1e3 << " k";
+    else
+        out << rate << ' ';
+
+    out << unit;
+    return out.str();
+}
+
+// Median times of the repetitions with the rates derived from them.
+void report(const Result& result, const std::size_t nameWidth)
+{
+    std::cerr << std::left << std::setw(nameWidth) << result.name
+              << std::right;
+
+    if (!result.error.empty())
+    {
+        std::cerr << "  ERROR: " << result.error << std::endl;
+        return;
+    }
+
+    std::vector<double> realTimes, cpuTimes;
+
+    for (const Run& run : result.runs)
+    {
+        realTimes.push_back(run.real);
+        cpuTimes.push_back(run.cpu);
+    }
+
+    const double t{median(realTimes)};
+    std::cerr << std::setw(13) << formatTime(t) << std::setw(13)
+              << formatTime(median(cpuTimes)) << std::setw(12)
+              << result.runs.front().iterations << "  +-" << std::fixed
+              << std::setprecision(1)
+              << 100 * stddev(realTimes) / mean(realTimes)
+              << '%' << std::defaultfloat;
+
+    if (result.items)
+        std::cerr << "  " << formatRate(result.items / t, "items/s");
+
+    if (result.bytes)
+        std::cerr << "  " << formatRate(result.bytes / t, "B/s");
+
+    std::cerr << std::endl;
+}
+
+std::string quoted(const std::string_view s)
+{
+    std::string out{"\""};
+
+    for (char c : s)
+    {
+        if (c == '"' || c == '\\')
+            out += '\\';
+
+        out += c;
+    }
+
+    return out + '"';
+}
+
+// One entry of the "benchmarks" array. Times are in nanoseconds; runs that
+// are aggregates of the repetitions carry their kind.
+void writeEntry(std::ostream& out, const Result& result, const int index,
+                const std::string_view aggregate, const double iterations,
+                const double realTime, const double cpuTime, bool& first)
+{
+    out << (first ? "\n" : ",\n") << "    {\"name\": "
+        << quoted(aggregate.empty() ? result.name
+                                    : result.name + '_' +
+                                          std::string{aggregate})
+        << ", \"run_name\": " << quoted(result.name) << ", \"run_type\": "
+        << (aggregate.empty() ? "\"iteration\"" : "\"aggregate\"")
+        << ", \"repetitions\": " << result.runs.size();
+
+    if (aggregate.empty())
+        out << ", \"repetition_index\": " << index;
+    else
+        out << ", \"aggregate_name\": " << quoted(aggregate);
+
+    out << ", \"threads\": 1, \"iterations\": " << iterations
+        << ", \"real_time\": " << realTime * 1e9
+        << ", \"cpu_time\": " << cpuTime * 1e9
+        << ", \"time_unit\": \"ns\"";
+
+    // Rates of the stddev entry would be meaningless.
+    if (aggregate != "stddev")
+    {
+        if (result.items)
+            out << ", \"items_per_second\": " << result.items / realTime;
+
+        if (result.bytes)
+            out << ", \"bytes_per_second\": " << result.bytes / realTime;
+    }
+
+    out << '}';
+    first = false;
+}
+
+// Google Benchmark's JSON layout: a context object describing the machine
+// and build, and one entry per repetition followed by the mean, median and
+// standard deviation of each benchmark.
+bool writeJson(const std::string& filename, const std::vector<Result>& results,
+               const char* executable)
+{
+    std::ofstream file;
+    std::ostream* out{&std::cout};
+
+    if (filename != "-")
+    {
+        file.open(filename);
+
+        if (!file)
+        {
+            std::cerr << "Cannot open file " << filename << std::endl;
+            return false;
+        }
+
+        out = &file;
+    }
+
+    const std::time_t now{std::time(nullptr)};
+    char date[32];
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S",
+                  std::localtime(&now));
+
+    *out << std::setprecision(10) << "{\n  \"context\": {\n"
+         << "    \"date\": " << quoted(date) << ",\n"
+         << "    \"executable\": " << quoted(executable) << ",\n"
+         << "    \"num_cpus\": " << std::thread::hardware_concurrency()
+         << ",\n"
+         << "    \"omp_threads\": " << maxThreads() << ",\n"
+         << "    \"isa\": " << quoted(isaName(rasterIsa)) << ",\n"
+         << "    \"real\": "
+         << (sizeof(real) == 8 ? "\"double\"" : "\"float\"") << ",\n"
+         << "    \"profile\": " << (profile::enabled ? "true" : "false")
+         << ",\n"
+#ifdef NDEBUG
+         << "    \"library_build_type\": \"release\"\n"
+#else
+         << "    \"library_build_type\": \"debug\"\n"
+#endif
+         << "  },\n  \"benchmarks\": [";
+
+    bool first{true};
+
+    for (const Result& result : results)
+    {
+        if (!result.error.empty())
+        {
+            *out << (first ? "\n" : ",\n") << "    {\"name\": "
+                 << quoted(result.name) << ", \"run_name\": "
+                 << quoted(result.name)
+                 << ", \"run_type\": \"iteration\", \"error_occurred\": true"
+                 << ", \"error_message\": " << quoted(result.error) << '}';
+            first = false;
+            continue;
+        }
+
+        std::vector<double> realTimes, cpuTimes;
+
+        for (std::size_t i{0}; i < result.runs.size(); ++i)
+        {
+            const Run& run{result.runs[i]};
+            writeEntry(*out, result, static_cast<int>(i), "",
+                       static_cast<double>(run.iterations), run.real, run.cpu,
+                       first);
+            realTimes.push_back(run.real);
+            cpuTimes.push_back(run.cpu);
+        }
+
+        const double iterations{
+            static_cast<double>(result.runs.front().iterations)};
+        writeEntry(*out, result, 0, "mean", iterations, mean(realTimes),
+                   mean(cpuTimes), first);
+        writeEntry(*out, result, 0, "median", iterations, median(realTimes),
+                   median(cpuTimes), first);
+        writeEntry(*out, result, 0, "stddev", iterations, stddev(realTimes),
+                   stddev(cpuTimes), first);
+    }
+
+    *out << "\n  ]\n}\n";
+    out->flush();
+
+    if (!*out)
+    {
+        std::cerr << "Error writing " << filename << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+}  // namespace
+
+void add(const std::string& name, std::function<void(State&)> function)
+{
+    registry.push_back({name, std::move(function)});
+}
+
+}  // namespace bench
+
+int main(int argc, char** argv)
+{
+    std::vector<std::string> filters;
+    std::string jsonFile;
+    double minTime{0.5};
+    int repetitions{3};
+    bool list{false};
+
+    for (int i{1}; i < argc; ++i)
+    {
+        const std::string_view arg{argv[i]};
+
+        if (arg.starts_with("--filter="))
+            filters.emplace_back(arg.substr(9));
+        else if (arg.starts_with("--json="))
+            jsonFile = arg.substr(7);
+        else if (arg.starts_with("--min-time="))
+            minTime = std::max(0.0, std::atof(argv[i] + 11));
+        else if (arg.starts_with("--repetitions="))
+            repetitions = std::max(1, std::atoi(argv[i] + 14));
+        else if (arg == "--list")
+            list = true;
+        else
+        {
+            std::cerr << "Usage: " << argv[0] << " [options]\n"
+                      << "  --filter=SUBSTRING...  --list\n"
+                      << "  --min-time=SECONDS  --repetitions=N"
+                         "  --json=FILE|-"
+                      << std::endl;
+            return 1;
+        }
+    }
+
+    bench::addMicroBenchmarks();
+    bench::addMacroBenchmarks();
+
+    // A benchmark runs when its name contains any of the filters.
+    std::vector<const bench::Benchmark*> selected;
+    std::size_t nameWidth{4};
+
+    for (const bench::Benchmark& benchmark : bench::registry)
+    {
+        if (!filters.empty() &&
+            std::none_of(filters.begin(), filters.end(),
+                         [&](const std::string& f)
+                         { return benchmark.name.find(f) != f.npos; }))
+            continue;
+
+        selected.push_back(&benchmark);
+        nameWidth = std::max(nameWidth, benchmark.name.size());
+    }
+
+    if (list)
+    {
+        for (const bench::Benchmark* benchmark : selected)
+            std::cout << benchmark->name << '\n';
+
+        return 0;
+    }
+
+    std::cerr << std::left << std::setw(nameWidth) << "name" << std::right
+              << std::setw(13) << "time" << std::setw(13) << "cpu"
+              << std::setw(12) << "iterations" << std::endl;
+
+    std::vector<bench::Result> results;
+
+    for (const bench::Benchmark* benchmark : selected)
+    {
+        results.push_back(bench::run(*benchmark, minTime, repetitions));
+        bench::report(results.back(), nameWidth);
+    }
+
+    if (!jsonFile.empty() && !bench::writeJson(jsonFile, results, argv[0]))
+        return 1;
+
+    return std::any_of(results.begin(), results.end(),
+                       [](const bench::Result& r) { return !r.error.empty(); })
+               ? 1
+               : 0;
+}
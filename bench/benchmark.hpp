@@ -0,0 +1,135 @@
+#pragma once
+
+#include <chrono>
+#include <ctime>
+#include <functional>
+#include <string>
+
+// A small harness in the style of Google Benchmark, without the dependency.
+// A benchmark is a function of a State that runs its timed code once per
+// iteration of a range-for over the state:
+//
+//     bench::add("invertTranspose", [](bench::State& state)
+//                {
+//                    for (auto _ : state)
+//                        bench::doNotOptimize(m.invertTranspose());
+//                });
+//
+// The runner picks an iteration count that fills the minimum time, repeats
+// the measurement and reports the time per iteration. Results can be written
+// as JSON in Google Benchmark's format, so its compare.py diffs two runs.
+namespace bench
+{
+
+class State
+{
+   public:
+    explicit State(const long long iterations) : iterations(iterations) {}
+
+    // What the loop variable holds; nothing, and allowed to go unused.
+    struct [[maybe_unused]] Value
+    {
+    };
+
+    class Iterator
+    {
+       public:
+        Iterator(State* state, const long long left) : state(state), left(left)
+        {
+        }
+
+        Value operator*() const { return {}; }
+        void operator++() { --left; }
+
+        bool operator!=(const Iterator&)
+        {
+            if (left)
+                return true;
+
+            state->stopTiming();
+            return false;
+        }
+
+       private:
+        State* state;
+        long long left;
+    };
+
+    Iterator begin()
+    {
+        resumeTiming();
+        return {this, iterations};
+    }
+
+    Iterator end() { return {this, 0}; }
+
+    // Keeps setup inside the loop out of the measurement.
+    void pauseTiming() { stopTiming(); }
+    void resumeTiming();
+
+    // Work done by each iteration, reported as rates.
+    void setItemsPerIteration(const double n) { items = n; }
+    void setBytesPerIteration(const double n) { bytes = n; }
+
+    // Ends the benchmark without a result; the runner reports message.
+    void skipWithError(const std::string& message)
+    {
+        error = message;
+        iterations = 0;
+    }
+
+    long long iterations;
+    double items{0};
+    double bytes{0};
+    std::string error{};
+    double realSeconds{0};
+    double cpuSeconds{0};
+
+   private:
+    bool running{false};
+    std::chrono::steady_clock::time_point realStart{};
+    std::clock_t cpuStart{};
+
+    void stopTiming();
+};
+
+inline void State::resumeTiming()
+{
+    running = true;
+    cpuStart = std::clock();
+    realStart = std::chrono::steady_clock::now();
+}
+
+inline void State::stopTiming()
+{
+    if (!running)
+        return;
+
+    const auto realEnd{std::chrono::steady_clock::now()};
+    const std::clock_t cpuEnd{std::clock()};
+    running = false;
+    realSeconds +=
+        std::chrono::duration<double>(realEnd - realStart).count();
+    cpuSeconds += double(cpuEnd - cpuStart) / CLOCKS_PER_SEC;
+}
+
+// Makes the compiler assume value is read, so computing it is not removed.
+template <typename T>
+inline void doNotOptimize(const T& value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    const volatile char sink{*reinterpret_cast<const volatile char*>(&value)};
+    static_cast<void>(sink);
+#endif
+}
+
+// Registers a benchmark; they run in the order they were added.
+void add(const std::string& name, std::function<void(State&)> function);
+
+// The suites, in micro.cpp and macro.cpp.
+void addMicroBenchmarks();
+void addMacroBenchmarks();
+
+}  // namespace bench
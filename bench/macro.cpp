@@ -0,0 +1,135 @@
+// Macro-benchmarks: whole frames of the renderer's scene, one model at a
+// time, at several resolutions, with both backends and several thread
+// counts. Items are the model's triangles, so the rate is in triangles per
+// second as the renderer reports it.
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "assembly.hpp"
+#include "benchmark.hpp"
+#include "binner.hpp"
+#include "framebuffer.hpp"
+#include "gl.hpp"
+#include "model.hpp"
+#include "phongshader.hpp"
+#include "raster.hpp"
+
+namespace
+{
+
+enum class Backend
+{
+    Immediate,
+    Binned
+};
+
+// Models are loaded once, from their cache when it is up to date, and kept
+// for every benchmark that renders them.
+const Model* loadModel(const std::string& name)
+{
+    static std::map<std::string, std::unique_ptr<Model>> models;
+    std::unique_ptr<Model>& model{models[name]};
+
+    if (!model)
+        model = std::make_unique<Model>("obj/" + name + ".obj");
+
+    return model->nfaces() ? model.get() : nullptr;
+}
+
+// Renders the model the way the renderer draws its default view: vertex
+// stage, primitive assembly, then rasterization straight away or binned
+// into tiles and flushed.
+void benchRender(bench::State& state, const std::string& name, const int size,
+                 const Backend backend, const int nthreads)
+{
+    const Model* const model{loadModel(name)};
+
+    if (!model)
+    {
+        state.skipWithError("cannot load obj/" + name + ".obj");
+        return;
+    }
+
+    constexpr vec3 light{1, 1, 1};
+    constexpr vec3 eye{-1, 0, 2};
+    constexpr vec3 center{0, 0, 0};
+    constexpr vec3 up{0, 1, 0};
+
+    lookAt(eye, center, up);
+    initPerspective(norm(eye - center));
+    initViewport(size / 16, size / 16, size * 7 / 8, size * 7 / 8);
+
+    PhongShader shader(light, *model);
+    Framebuffer framebuffer(size, size);
+    PrimitiveAssembler assembler(size, size);
+    TileBinner binner(size, size);
+    const int nvertices{model->nvertices()};
+    const int nfaces{model->nfaces()};
+    const std::uint32_t* const indices{model->indexBuffer().data()};
+    std::vector<vec4> transformed(nvertices);
+
+    for (auto _ : state)
+    {
+        framebuffer.clear();
+        shader.bindUniforms();
+
+#pragma omp parallel for num_threads(nthreads)
+
+        for (int v = 0; v < nvertices; ++v) transformed[v] = shader.vertex(v);
+
+        assembler.bind(transformed);
+
+        for (int f{0}; f < nfaces; ++f)
+        {
+            TriangleSetup pieces[2];
+            const int npieces{assembler.assemble(f, &indices[f * 3], pieces)};
+
+            for (int p{0}; p < npieces; ++p)
+            {
+                if (backend == Backend::Binned)
+                    binner.submit(pieces[p]);
+                else
+                    rasterize(pieces[p], shader, framebuffer, nthreads);
+            }
+        }
+
+        if (backend == Backend::Binned)
+            binner.flush(shader, framebuffer, nthreads);
+    }
+
+    state.setItemsPerIteration(nfaces);
+}
+
+}  // namespace
+
+void bench::addMacroBenchmarks()
+{
+    // Powers of two up to the machine's threads, and all of them.
+    std::vector<int> threadCounts;
+
+    for (int t{1}; t < maxThreads(); t *= 2) threadCounts.push_back(t);
+
+    threadCounts.push_back(maxThreads());
+
+    for (const std::string name : {"african_head", "diablo3"})
+    {
+        for (int size : {400, 800, 1600})
+        {
+            for (Backend backend : {Backend::Immediate, Backend::Binned})
+            {
+                const std::string prefix{
+                    "render/" + name + '/' + std::to_string(size) + 'x' +
+                    std::to_string(size) +
+                    (backend == Backend::Binned ? "/binned" : "/immediate")};
+
+                for (int nthreads : threadCounts)
+                    add(prefix + "/threads:" + std::to_string(nthreads),
+                        [=](State& state)
+                        { benchRender(state, name, size, backend, nthreads); });
+            }
+        }
+    }
+}
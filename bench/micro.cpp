@@ -0,0 +1,260 @@
+// Micro-benchmarks of single kernels: matrix operations, rasterizing one
+// triangle by size, OBJ parsing and TGA decoding and encoding.
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "benchmark.hpp"
+#include "binner.hpp"
+#include "framebuffer.hpp"
+#include "geometry.hpp"
+#include "gl.hpp"
+#include "mappedfile.hpp"
+#include "model.hpp"
+#include "objparser.hpp"
+#include "raster.hpp"
+#include "tgaimage.hpp"
+
+namespace
+{
+
+const char* const modelNames[]{"african_head", "diablo3"};
+
+// Fixed pseudo-random matrices, diagonally dominant so every one is
+// invertible. Cycling through several keeps the compiler from folding the
+// operation on a constant.
+template <int n, typename T>
+std::vector<mat<n, n, T>> randomMatrices(const int count)
+{
+    std::mt19937 rng{42};
+    std::uniform_real_distribution<double> dist(-1, 1);
+    std::vector<mat<n, n, T>> matrices(count);
+
+    for (mat<n, n, T>& m : matrices)
+        for (int i{n}; i--;)
+            for (int j{n}; j--;) m[i][j] = T(dist(rng) + (i == j ? n : 0));
+
+    return matrices;
+}
+
+template <int n, typename T>
+void benchInvertTranspose(bench::State& state)
+{
+    const std::vector<mat<n, n, T>> matrices{randomMatrices<n, T>(64)};
+    std::size_t i{0};
+
+    for (auto _ : state)
+        bench::doNotOptimize(matrices[i++ & 63].invertTranspose());
+
+    state.setItemsPerIteration(1);
+}
+
+template <int n, typename T>
+void benchDet(bench::State& state)
+{
+    const std::vector<mat<n, n, T>> matrices{randomMatrices<n, T>(64)};
+    std::size_t i{0};
+
+    for (auto _ : state) bench::doNotOptimize(matrices[i++ & 63].det());
+
+    state.setItemsPerIteration(1);
+}
+
+// Transforms a vertex array by one matrix, as the vertex stage does.
+void benchMatVec(bench::State& state)
+{
+    constexpr int count{4096};
+    const mat<4, 4> m{randomMatrices<4, real>(1)[0]};
+    std::vector<vec4> in(count), out(count);
+    std::mt19937 rng{7};
+    std::uniform_real_distribution<real> dist(-1, 1);
+
+    for (vec4& v : in) v = {dist(rng), dist(rng), dist(rng), 1};
+
+    for (auto _ : state)
+    {
+        for (int i{0}; i < count; ++i) out[i] = m * in[i];
+
+        bench::doNotOptimize(out.data());
+    }
+
+    state.setItemsPerIteration(count);
+}
+
+// Writes one color without sampling anything, so that only the rasterizer
+// is measured. It shades packets like the renderer's shaders do.
+struct FlatShader final
+{
+    TGAColor color{{200, 100, 50, 255}};
+
+    std::pair<bool, TGAColor> fragment(const int, const vec3) const
+    {
+        return {false, color};
+    }
+
+    unsigned fragments(const FragmentPacket& packet, TGAColor colors[]) const
+    {
+        for (int k{0}; k < FragmentPacket::size; ++k) colors[k] = color;
+
+        return packet.mask;
+    }
+};
+
+// Rasterizes a right triangle with legs of size pixels. Each iteration
+// draws it a little nearer, so every covered pixel passes the depth test and
+// is shaded; items are the covered pixels.
+void benchRasterize(bench::State& state, const int size)
+{
+    constexpr int width{1024};
+    constexpr int height{1024};
+    const FlatShader shader;
+    Framebuffer framebuffer(width, height);
+
+    initViewport(0, 0, width, height);
+
+    const auto clip{[](const double x, const double y)
+                    {
+                        return vec4{real(2 * x / width - 1),
+                                    real(2 * y / height - 1), 0, 1};
+                    }};
+    const double x{(width - size) / 2 + 0.3};
+    const double y{(height - size) / 2 + 0.6};
+    const Triangle triangle{clip(x, y), clip(x + size, y),
+                            clip(x, y + size)};
+    TriangleSetup setup;
+
+    if (setupTriangle(0, triangle, width, height, setup) != Cull::None)
+    {
+        state.skipWithError("triangle culled");
+        return;
+    }
+
+    framebuffer.clear();
+    rasterize(setup, shader, framebuffer, maxThreads());
+    state.setItemsPerIteration(static_cast<double>(std::count_if(
+        framebuffer.depth(), framebuffer.depth() + width * height,
+        [](const double z) { return z > Framebuffer::farDepth; })));
+
+    for (auto _ : state)
+    {
+        setup.z0 += 1e-6;
+        setup.zmax += 1e-6;
+        rasterize(setup, shader, framebuffer, maxThreads());
+    }
+}
+
+void benchParseObj(bench::State& state, const std::string& name)
+{
+    const MappedFile text("obj/" + name + ".obj");
+    ObjMesh mesh;
+
+    if (!text)
+    {
+        state.skipWithError("cannot open obj/" + name + ".obj");
+        return;
+    }
+
+    const std::string_view view{reinterpret_cast<const char*>(text.data()),
+                                text.size()};
+
+    for (auto _ : state)
+    {
+        if (!parseObj(view, mesh))
+        {
+            state.skipWithError("parse error");
+            return;
+        }
+    }
+
+    state.setBytesPerIteration(static_cast<double>(text.size()));
+    state.setItemsPerIteration(static_cast<double>(mesh.facesVert.size() / 3));
+}
+
+// The whole load without the binary cache: parsing, building the indexed
+// mesh and decoding the normal map.
+void benchLoadModel(bench::State& state, const std::string& name)
+{
+    const std::string file{"obj/" + name + ".obj"};
+    int nfaces{0};
+
+    for (auto _ : state)
+    {
+        const Model model(file, false);
+        nfaces = model.nfaces();
+    }
+
+    if (!nfaces)
+        state.skipWithError("cannot load " + file);
+
+    state.setItemsPerIteration(nfaces);
+}
+
+void benchReadTGA(bench::State& state, const std::string& name)
+{
+    const std::string file{"obj/" + name + "_nm.tga"};
+    TGAImage image;
+
+    for (auto _ : state)
+    {
+        if (!image.readTGAFile(file))
+        {
+            state.skipWithError("cannot read " + file);
+            return;
+        }
+    }
+
+    state.setBytesPerIteration(3.0 * image.width() * image.height());
+}
+
+void benchEncodeTGA(bench::State& state, const std::string& name,
+                    const bool rle)
+{
+    const std::string file{"obj/" + name + "_nm.tga"};
+    TGAImage image;
+    std::vector<std::uint8_t> bytes;
+
+    if (!image.readTGAFile(file))
+    {
+        state.skipWithError("cannot read " + file);
+        return;
+    }
+
+    for (auto _ : state) image.encodeTGA(bytes, true, rle);
+
+    state.setBytesPerIteration(3.0 * image.width() * image.height());
+}
+
+}  // namespace
+
+void bench::addMicroBenchmarks()
+{
+    add("geometry/invertTranspose/mat4", benchInvertTranspose<4, real>);
+    add("geometry/invertTranspose/dmat3", benchInvertTranspose<3, double>);
+    add("geometry/det/mat4", benchDet<4, real>);
+    add("geometry/det/dmat3", benchDet<3, double>);
+    add("geometry/matvec/mat4", benchMatVec);
+
+    for (int size : {2, 8, 32, 128, 512})
+        add("rasterize/size:" + std::to_string(size),
+            [size](State& state) { benchRasterize(state, size); });
+
+    for (const std::string name : modelNames)
+    {
+        add("obj/parse/" + name,
+            [name](State& state) { benchParseObj(state, name); });
+        add("obj/load/" + name,
+            [name](State& state) { benchLoadModel(state, name); });
+    }
+
+    for (const std::string name : modelNames)
+    {
+        add("tga/read/" + name + "_nm",
+            [name](State& state) { benchReadTGA(state, name); });
+        add("tga/encode_rle/" + name + "_nm",
+            [name](State& state) { benchEncodeTGA(state, name, true); });
+        add("tga/encode_raw/" + name + "_nm",
+            [name](State& state) { benchEncodeTGA(state, name, false); });
+    }
+}
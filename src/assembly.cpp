@@ -0,0 +1,227 @@
+#include "assembly.hpp"
+
+#include <algorithm>
+
+extern mat<4, 4> ModelView, Perspective;
+extern mat<4, 4, double> Viewport;
+
+namespace
+{
+
+enum Outcode : std::uint8_t
+{
+    Left = 1,
+    Right = 2,
+    Bottom = 4,
+    Top = 8,
+    Near = 16
+};
+
+// Splits a triangle at w = kNearW with Sutherland-Hodgman, keeping the
+// winding, and fans the polygon in front of the plane into pieces. remap[p]
+// holds the barycentrics of the original triangle at each vertex of piece p.
+int clipNear(const Triangle& clip, Triangle pieces[2], dvec3 remap[2][3])
+{
+    constexpr dvec3 corners[3]{{1, 0, 0}, {0, 1, 0}, {0, 0, 1}};
+    dvec4 position[4];
+    dvec3 bary[4];
+    int n{0};
+
+    for (int i{0}; i < 3; ++i)
+    {
+        const int j{(i + 1) % 3};
+        const dvec4 pi{static_cast<dvec4>(clip[i])};
+        const dvec4 pj{static_cast<dvec4>(clip[j])};
+        const double di{pi.w - kNearW};
+        const double dj{pj.w - kNearW};
+
+        if (di >= 0)
+        {
+            position[n] = pi;
+            bary[n++] = corners[i];
+        }
+
+        if ((di >= 0) != (dj >= 0))
+        {
+            const double t{di / (di - dj)};
+            position[n] = pi + (pj - pi) * t;
+            bary[n++] = corners[i] + (corners[j] - corners[i]) * t;
+        }
+    }
+
+    for (int p{0}; p + 2 < n; ++p)
+    {
+        const int v[3]{0, p + 1, p + 2};
+
+        for (int k{3}; k--;)
+        {
+            pieces[p][k] = static_cast<vec4>(position[v[k]]);
+            remap[p][k] = bary[v[k]];
+        }
+    }
+
+    return std::max(0, n - 2);
+}
+
+// Framebuffer bounds in NDC under the current viewport, one pixel wider on
+// every side so that rounding never drops a triangle that reaches a sample.
+struct NdcRect
+{
+    double xlo, xhi, ylo, yhi;
+};
+
+NdcRect framebufferRect(const int width, const int height)
+{
+    return {(-1 - Viewport[0][3]) / Viewport[0][0],
+            (width + 1 - Viewport[0][3]) / Viewport[0][0],
+            (-1 - Viewport[1][3]) / Viewport[1][1],
+            (height + 1 - Viewport[1][3]) / Viewport[1][1]};
+}
+
+}  // namespace
+
+void AssemblyStats::count(const Cull cull)
+{
+    switch (cull)
+    {
+        case Cull::None:
+            ++emitted;
+            break;
+        case Cull::Backface:
+            ++backface;
+            break;
+        case Cull::Small:
+            ++small;
+            break;
+        case Cull::Offscreen:
+            ++frustum;
+            break;
+    }
+}
+
+int setupClipped(const int face, const Triangle& clip, const int width,
+                 const int height, TriangleSetup pieces[2],
+                 AssemblyStats& stats)
+{
+    if (clip[0].w >= kNearW && clip[1].w >= kNearW && clip[2].w >= kNearW)
+    {
+        const Cull cull{setupTriangle(face, clip, width, height, pieces[0])};
+        stats.count(cull);
+        return cull == Cull::None;
+    }
+
+    Triangle parts[2];
+    dvec3 remap[2][3];
+    const int nparts{clipNear(clip, parts, remap)};
+    int n{0};
+
+    ++stats.clipped;
+
+    for (int p{0}; p < nparts; ++p)
+    {
+        const Cull cull{
+            setupTriangle(face, parts[p], width, height, pieces[n])};
+        stats.count(cull);
+
+        if (cull != Cull::None)
+            continue;
+
+        pieces[n].clipped = true;
+
+        for (int k{3}; k--;) pieces[n].remap[k] = remap[p][k];
+
+        ++n;
+    }
+
+    return n;
+}
+
+PrimitiveAssembler::PrimitiveAssembler(const int width, const int height)
+    : width(width), height(height)
+{
+}
+
+void PrimitiveAssembler::bind(const std::span<const vec4> clip)
+{
+    const NdcRect rect{framebufferRect(width, height)};
+    const real xlo{static_cast<real>(rect.xlo)};
+    const real xhi{static_cast<real>(rect.xhi)};
+    const real ylo{static_cast<real>(rect.ylo)};
+    const real yhi{static_cast<real>(rect.yhi)};
+    const std::size_t n{clip.size()};
+
+    vertices = clip;
+    outcodes.resize(n);
+
+    for (std::size_t i{0}; i < n; ++i)
+    {
+        const vec4& v{clip[i]};
+        outcodes[i] = (v.x < xlo * v.w) * Left | (v.x > xhi * v.w) * Right |
+                      (v.y < ylo * v.w) * Bottom | (v.y > yhi * v.w) * Top |
+                      (v.w < kNearW) * Near;
+    }
+}
+
+int PrimitiveAssembler::assemble(const int face, const std::uint32_t* index,
+                                 TriangleSetup pieces[2])
+{
+    const std::uint8_t c0{outcodes[index[0]]};
+    const std::uint8_t c1{outcodes[index[1]]};
+    const std::uint8_t c2{outcodes[index[2]]};
+
+    ++stats.triangles;
+
+    if (c0 & c1 & c2)
+    {
+        ++stats.frustum;
+        return 0;
+    }
+
+    const Triangle clip{vertices[index[0]], vertices[index[1]],
+                        vertices[index[2]]};
+
+    return setupClipped(face, clip, width, height, pieces, stats);
+}
+
+void PrimitiveAssembler::bindView(const vec3 eye)
+{
+    const mat<4, 4> mvp{Perspective * ModelView};
+    const dvec4 x{static_cast<dvec4>(mvp[0])};
+    const dvec4 y{static_cast<dvec4>(mvp[1])};
+    const dvec4 w{static_cast<dvec4>(mvp[3])};
+    const NdcRect rect{framebufferRect(width, height)};
+
+    // Each plane p keeps the model-space points v with p * (v, 1) >= 0, the
+    // same half-spaces the vertex outcodes test in clip space.
+    this->eye = eye;
+    planes[0] = x - w * rect.xlo;
+    planes[1] = w * rect.xhi - x;
+    planes[2] = y - w * rect.ylo;
+    planes[3] = w * rect.yhi - y;
+    planes[4] = w - dvec4{0, 0, 0, kNearW};
+}
+
+bool PrimitiveAssembler::cull(const Meshlet& meshlet)
+{
+    const dvec4 center{meshlet.center.x, meshlet.center.y, meshlet.center.z,
+                       1};
+
+    ++stats.meshlets;
+
+    for (const dvec4& p : planes)
+    {
+        if (p * center < -meshlet.radius * norm(p.xyz()))
+        {
+            ++stats.meshletsFrustum;
+            return true;
+        }
+    }
+
+    if (backfacing(meshlet, eye))
+    {
+        ++stats.meshletsBackface;
+        return true;
+    }
+
+    return false;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "gl.hpp"
+#include "mesh.hpp"
+
+// Vertices must satisfy w >= kNearW in clip space; triangles crossing that
+// plane are clipped to it. w is the distance from the eye along the view
+// axis in units of the perspective focal length.
+constexpr double kNearW{0.01};
+
+// Triangles seen by primitive assembly and how many each stage dropped.
+// Clipped triangles can split in two, and from there on pieces are counted.
+struct AssemblyStats
+{
+    long long triangles{0};
+    long long frustum{0};
+    long long clipped{0};
+    long long backface{0};
+    long long small{0};
+    long long emitted{0};
+    long long meshlets{0};
+    long long meshletsFrustum{0};
+    long long meshletsBackface{0};
+
+    void count(const Cull cull);
+};
+
+// Clips a triangle at the near plane and sets up the pieces in front of it,
+// or the triangle itself when no vertex is behind the plane. Returns how
+// many pieces were set up (0 to 2); the rejected ones are counted in stats.
+int setupClipped(const int face, const Triangle& clip, const int width,
+                 const int height, TriangleSetup pieces[2],
+                 AssemblyStats& stats);
+
+// Primitive assembly between the vertex stage and the rasterizer. Each draw
+// first classifies its clip-space vertices against the frustum in one pass;
+// a triangle whose three vertices lie outside the same plane is then dropped
+// with two ANDs, before any division. The side planes bound the framebuffer
+// rather than the viewport, since the rasterizer draws the whole
+// framebuffer. Survivors are clipped at the near plane and set up, which
+// drops backfacing and small triangles. Meshlets can be culled as a whole
+// before their vertices are shaded.
+class PrimitiveAssembler
+{
+   public:
+    AssemblyStats stats{};
+
+    PrimitiveAssembler(const int width, const int height);
+
+    // Classifies the vertices of the next draw with the current viewport.
+    // They must stay alive and unchanged until the draw is assembled.
+    void bind(std::span<const vec4> clip);
+
+    // Assembles triangle face whose vertices are index[0..2] of the bound
+    // array into at most two set-up pieces; returns how many.
+    int assemble(const int face, const std::uint32_t* index,
+                 TriangleSetup pieces[2]);
+
+    // Takes the frustum planes into model space with the current transforms
+    // for meshlet culling, with the eye at eye.
+    void bindView(const vec3 eye);
+
+    // Whether meshlet is outside the frustum by its bounding sphere, or
+    // backfacing by its normal cone, as seen from the bound view.
+    bool cull(const Meshlet& meshlet);
+
+   private:
+    int width;
+    int height;
+    vec3 eye{};
+    dvec4 planes[5]{};
+    std::span<const vec4> vertices{};
+    std::vector<std::uint8_t> outcodes{};
+};
@@ -0,0 +1,102 @@
+#include "binner.hpp"
+
+#include <algorithm>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+int maxThreads()
+{
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+TileBinner::TileBinner(const int width, const int height)
+    : width(width),
+      height(height),
+      tilesX((width + tileSize - 1) / tileSize),
+      tilesY((height + tileSize - 1) / tileSize),
+      bins(tilesX * tilesY)
+{
+}
+
+void TileBinner::submit(const TriangleSetup& setup)
+{
+    if (triangleOccluded(setup))
+        return;
+
+    const std::uint32_t idx{static_cast<std::uint32_t>(triangles.size())};
+    triangles.push_back(setup);
+
+    for (int ty{setup.bbminy / tileSize}; ty <= setup.bbmaxy / tileSize; ++ty)
+        for (int tx{setup.bbminx / tileSize}; tx <= setup.bbmaxx / tileSize;
+             ++tx)
+            bins[tx + ty * tilesX].push_back(idx);
+}
+
+void TileBinner::clear()
+{
+    triangles.clear();
+    for (std::vector<std::uint32_t>& bin : bins) bin.clear();
+}
+
+void TileBinner::loadTile(const int tile, const Framebuffer& framebuffer,
+                          TileDepth& depth) const
+{
+    const double* const zbuffer{framebuffer.depth()};
+    const double* const zbufferMin{framebuffer.depthMin()};
+
+    constexpr int B{DepthView::blockSize};
+    constexpr int tileBlocks{tileSize / B};
+
+    depth.x0 = (tile % tilesX) * tileSize;
+    depth.y0 = (tile / tilesX) * tileSize;
+    depth.x1 = std::min(depth.x0 + tileSize, width) - 1;
+    depth.y1 = std::min(depth.y0 + tileSize, height) - 1;
+    depth.view = {depth.z, depth.zmin, depth.x0, depth.y0, tileSize,
+                  tileBlocks};
+
+    const int rowLen{depth.x1 - depth.x0 + 1};
+    const int blockStride{(width + B - 1) / B};
+    const int bx0{depth.x0 / B};
+    const int by0{depth.y0 / B};
+    const int blocksX{(depth.x1 - depth.x0) / B + 1};
+    const int blocksY{(depth.y1 - depth.y0) / B + 1};
+
+    for (int y{depth.y0}; y <= depth.y1; ++y)
+        std::copy_n(&zbuffer[depth.x0 + y * width], rowLen,
+                    &depth.view.at(depth.x0, y));
+
+    for (int by{0}; by < blocksY; ++by)
+        std::copy_n(&zbufferMin[bx0 + (by0 + by) * blockStride], blocksX,
+                    &depth.zmin[by * tileBlocks]);
+}
+
+void TileBinner::storeTile(const TileDepth& depth,
+                           Framebuffer& framebuffer) const
+{
+    double* const zbuffer{framebuffer.depth()};
+    double* const zbufferMin{framebuffer.depthMin()};
+
+    constexpr int B{DepthView::blockSize};
+    constexpr int tileBlocks{tileSize / B};
+
+    const int rowLen{depth.x1 - depth.x0 + 1};
+    const int blockStride{(width + B - 1) / B};
+    const int bx0{depth.x0 / B};
+    const int by0{depth.y0 / B};
+    const int blocksX{(depth.x1 - depth.x0) / B + 1};
+    const int blocksY{(depth.y1 - depth.y0) / B + 1};
+
+    for (int y{depth.y0}; y <= depth.y1; ++y)
+        std::copy_n(&depth.view.at(depth.x0, y), rowLen,
+                    &zbuffer[depth.x0 + y * width]);
+
+    for (int by{0}; by < blocksY; ++by)
+        std::copy_n(&depth.zmin[by * tileBlocks], blocksX,
+                    &zbufferMin[bx0 + (by0 + by) * blockStride]);
+}
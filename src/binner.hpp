@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "raster.hpp"
+
+int maxThreads();
+
+// Sorts triangles into screen tiles up front, then renders each tile as an
+// independent work item with its own copy of the z-buffer, so workers never
+// touch the same pixel and no per-triangle synchronisation is needed.
+class TileBinner
+{
+   public:
+    static constexpr int tileSize{64};
+
+    TileBinner(const int width, const int height);
+
+    void submit(const TriangleSetup& setup);
+    template <FragmentShader Shader>
+    void flush(const Shader& shader, Framebuffer& framebuffer,
+               const int nthreads);
+
+    int ntriangles() const { return static_cast<int>(triangles.size()); }
+
+   private:
+    int width;
+    int height;
+    int tilesX;
+    int tilesY;
+    std::vector<TriangleSetup> triangles{};
+    std::vector<std::vector<std::uint32_t>> bins{};
+
+    // Tile-local copy of the z-buffer and its block minima.
+    struct TileDepth
+    {
+        double z[tileSize * tileSize];
+        double zmin[(tileSize / DepthView::blockSize) *
+                    (tileSize / DepthView::blockSize)];
+        int x0, y0, x1, y1;
+        DepthView view;
+    };
+
+    void loadTile(const int tile, const Framebuffer& framebuffer,
+                  TileDepth& depth) const;
+    void storeTile(const TileDepth& depth, Framebuffer& framebuffer) const;
+    void clear();
+
+    template <FragmentShader Shader>
+    void renderTile(const int tile, const Shader& shader,
+                    Framebuffer& framebuffer) const;
+};
+
+template <FragmentShader Shader>
+void TileBinner::flush(const Shader& shader, Framebuffer& framebuffer,
+                       const int nthreads)
+{
+    const int ntiles{tilesX * tilesY};
+
+#pragma omp parallel for schedule(dynamic) num_threads(nthreads)
+
+    for (int tile = 0; tile < ntiles; ++tile)
+        renderTile(tile, shader, framebuffer);
+
+    clear();
+}
+
+template <FragmentShader Shader>
+void TileBinner::renderTile(const int tile, const Shader& shader,
+                            Framebuffer& framebuffer) const
+{
+    const std::vector<std::uint32_t>& bin{bins[tile]};
+
+    if (bin.empty())
+        return;
+
+    TileDepth depth;
+    loadTile(tile, framebuffer, depth);
+
+    for (const std::uint32_t idx : bin)
+        rasterizeRect(triangles[idx], depth.x0, depth.y0, depth.x1, depth.y1,
+                      shader, framebuffer, depth.view);
+
+    storeTile(depth, framebuffer);
+}
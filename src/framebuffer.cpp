@@ -0,0 +1,54 @@
+#include "framebuffer.hpp"
+
+#include <algorithm>
+
+Framebuffer::Framebuffer(const int width, const int height)
+    : w(width),
+      h(height),
+      color(static_cast<std::size_t>(width) * height),
+      zbuffer(static_cast<std::size_t>(width) * height + depthBlockSize - 1),
+      zbufferMin(static_cast<std::size_t>(blockStride()) * blockRows())
+{
+    clear();
+}
+
+void Framebuffer::clear(const std::uint32_t clearColor)
+{
+    std::fill(color.begin(), color.end(), clearColor);
+    std::fill(zbuffer.begin(), zbuffer.end(), farDepth);
+    std::fill(zbufferMin.begin(), zbufferMin.end(), farDepth);
+
+    for (Target& t : targets)
+        std::fill(t.data.begin(), t.data.end(), t.clearValue);
+}
+
+int Framebuffer::addTarget(const std::uint32_t clearValue)
+{
+    targets.push_back(
+        {clearValue, AlignedBuffer<std::uint32_t>(
+                         static_cast<std::size_t>(w) * h, clearValue)});
+    return static_cast<int>(targets.size()) - 1;
+}
+
+TGAImage Framebuffer::toImage(const TGAImage::Format format) const
+{
+    TGAImage image(w, h, format);
+    toImage(color.data(), image);
+    return image;
+}
+
+void Framebuffer::toImage(const std::uint32_t* colors, TGAImage& image)
+{
+    const int w{image.width()};
+    const int h{image.height()};
+    TGAColor c;
+
+    for (int y{0}; y < h; ++y)
+    {
+        for (int x{0}; x < w; ++x)
+        {
+            std::memcpy(c.rgba.data(), &colors[x + y * w], 4);
+            image.set(x, y, c);
+        }
+    }
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <vector>
+
+#include "tgaimage.hpp"
+
+// Allocator that starts every attachment on a cache line, so rows of the
+// 8x8 depth blocks and packets of colors never straddle one needlessly.
+template <typename T>
+struct CacheAligned
+{
+    using value_type = T;
+    static constexpr std::align_val_t alignment{64};
+
+    CacheAligned() = default;
+
+    template <typename U>
+    CacheAligned(const CacheAligned<U>&) noexcept
+    {
+    }
+
+    T* allocate(const std::size_t n)
+    {
+        return static_cast<T*>(::operator new(n * sizeof(T), alignment));
+    }
+
+    void deallocate(T* p, const std::size_t) noexcept
+    {
+        ::operator delete(p, alignment);
+    }
+
+    template <typename U>
+    bool operator==(const CacheAligned<U>&) const noexcept
+    {
+        return true;
+    }
+};
+
+template <typename T>
+using AlignedBuffer = std::vector<T, CacheAligned<T>>;
+
+// Render target with typed attachments: RGBA8 color packed in 32 bits (bytes
+// in TGAColor order), one double depth per pixel plus the conservative
+// minimum of every 8x8 block, and any number of extra 32-bit targets for
+// G-buffer data such as triangle IDs. Pixels are stored row-major and writes
+// are unchecked; the image is converted to a TGAImage once, for output.
+class Framebuffer
+{
+   public:
+    static constexpr int depthBlockSize{8};
+    static constexpr double farDepth{-1000.0};
+
+    Framebuffer() = default;
+    Framebuffer(const int width, const int height);
+
+    int width() const noexcept { return w; }
+    int height() const noexcept { return h; }
+
+    // Resets color, depth and every extra target to its clear value.
+    void clear(const std::uint32_t clearColor = 0);
+
+    void set(const int x, const int y, const TGAColor& c)
+    {
+        std::memcpy(&color[x + y * w], c.rgba.data(), 4);
+    }
+
+    std::uint32_t get(const int x, const int y) const
+    {
+        return color[x + y * w];
+    }
+
+    // Depth rows are read 8 pixels at a time, so the buffer carries 7
+    // entries of padding after the last pixel.
+    double* depth() noexcept { return zbuffer.data(); }
+    const double* depth() const noexcept { return zbuffer.data(); }
+    double* depthMin() noexcept { return zbufferMin.data(); }
+    const double* depthMin() const noexcept { return zbufferMin.data(); }
+    int blockStride() const noexcept
+    {
+        return (w + depthBlockSize - 1) / depthBlockSize;
+    }
+    int blockRows() const noexcept
+    {
+        return (h + depthBlockSize - 1) / depthBlockSize;
+    }
+
+    // Adds a 32-bit target reset to clearValue by clear(); returns its index.
+    int addTarget(const std::uint32_t clearValue);
+    std::uint32_t* target(const int i) noexcept
+    {
+        return targets[i].data.data();
+    }
+
+    // Packed colors, width() * height() of them row by row.
+    const std::uint32_t* colors() const noexcept { return color.data(); }
+
+    TGAImage toImage(const TGAImage::Format format = TGAImage::RGB) const;
+
+    // Unpacks colors of an image of the same size as image into it.
+    static void toImage(const std::uint32_t* colors, TGAImage& image);
+
+   private:
+    struct Target
+    {
+        std::uint32_t clearValue;
+        AlignedBuffer<std::uint32_t> data;
+    };
+
+    int w{0};
+    int h{0};
+    AlignedBuffer<std::uint32_t> color{};
+    AlignedBuffer<double> zbuffer{};
+    AlignedBuffer<double> zbufferMin{};
+    std::vector<Target> targets{};
+};
@@ -0,0 +1,79 @@
+#include "framewriter.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+#include "profile.hpp"
+
+FrameWriter::FrameWriter(const int width, const int height,
+                         const ImageFormat format)
+    : width(width),
+      height(height),
+      colors(static_cast<std::size_t>(width) * height),
+      encoder(makeImageWriter(format)),
+      worker(&FrameWriter::run, this)
+{
+}
+
+FrameWriter::~FrameWriter()
+{
+    {
+        std::unique_lock lock(mutex);
+        cv.wait(lock, [this] { return !pending; });
+        stop = true;
+    }
+
+    cv.notify_all();
+    worker.join();
+}
+
+void FrameWriter::submit(const Framebuffer& framebuffer,
+                         const std::filesystem::path& filename)
+{
+    std::unique_lock lock(mutex);
+    cv.wait(lock, [this] { return !pending; });
+
+    std::copy_n(framebuffer.colors(), colors.size(), colors.begin());
+    this->filename = filename;
+    pending = true;
+    lock.unlock();
+    cv.notify_all();
+}
+
+bool FrameWriter::finish()
+{
+    std::unique_lock lock(mutex);
+    cv.wait(lock, [this] { return !pending; });
+    return ok;
+}
+
+void FrameWriter::run()
+{
+    std::unique_lock lock(mutex);
+
+    for (;;)
+    {
+        cv.wait(lock, [this] { return pending || stop; });
+
+        if (!pending)
+            return;
+
+        // The submitting thread waits for pending to clear before touching
+        // the buffer again, so the frame can be written without the lock.
+        lock.unlock();
+
+        PROFILE_SCOPE(ImageWrite);
+        const auto start{std::chrono::steady_clock::now()};
+        encoder->encode(colors.data(), width, height, bytes);
+        const auto encoded{std::chrono::steady_clock::now()};
+        const bool written{writeBytes(filename, bytes)};
+        const auto end{std::chrono::steady_clock::now()};
+
+        lock.lock();
+        ok &= written;
+        busy += std::chrono::duration<double>(end - start).count();
+        encoding += std::chrono::duration<double>(encoded - start).count();
+        pending = false;
+        cv.notify_all();
+    }
+}
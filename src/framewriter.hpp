@@ -0,0 +1,58 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "framebuffer.hpp"
+#include "imagewriter.hpp"
+
+// Writes rendered frames to image files on a background thread, so that
+// encoding frame N overlaps rendering frame N + 1. At most one frame is in
+// flight: submit() copies the color attachment into a buffer owned by the
+// writer and only blocks while the previous frame is still being written.
+// The buffers are allocated once. A file name of "-" writes the frame to
+// standard output, so a sequence can be piped to a video encoder.
+class FrameWriter
+{
+   public:
+    FrameWriter(const int width, const int height, const ImageFormat format);
+    ~FrameWriter();
+
+    FrameWriter(const FrameWriter&) = delete;
+    FrameWriter& operator=(const FrameWriter&) = delete;
+
+    void submit(const Framebuffer& framebuffer,
+                const std::filesystem::path& filename);
+
+    // Waits for the last submitted frame. Returns false when any write
+    // failed.
+    bool finish();
+
+    // Time the background thread spent encoding and writing, and encoding
+    // alone, in seconds.
+    double busySeconds() const { return busy; }
+    double encodeSeconds() const { return encoding; }
+
+   private:
+    int width;
+    int height;
+    AlignedBuffer<std::uint32_t> colors;
+    std::unique_ptr<ImageWriter> encoder;
+    std::vector<std::uint8_t> bytes{};
+    std::filesystem::path filename{};
+    bool pending{false};
+    bool stop{false};
+    bool ok{true};
+    double busy{0};
+    double encoding{0};
+    std::mutex mutex{};
+    std::condition_variable cv{};
+    std::thread worker;
+
+    void run();
+};
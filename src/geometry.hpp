@@ -3,194 +3,257 @@
 #include <cassert>
 #include <cmath>
 #include <iostream>
-
-template <int n>
+#include <type_traits>
+
+// Scalar type of the default vec/mat aliases used throughout the pipeline.
+// Configure with -DRASTERIZER_DOUBLE=ON to switch everything to double;
+// stages that need the extra precision spell out double explicitly.
+#ifdef RASTERIZER_DOUBLE
+typedef double real;
+#else
+typedef float real;
+#endif
+
+// The scalar operand of mixed vec/scalar operators is not deduced, so that
+// expressions such as v * 2.0 work for any T.
+template <typename T>
+using scalar = std::type_identity_t<T>;
+
+template <int n, typename T = real>
 struct vec
 {
-    double data[n]{0};
+    T data[n]{};
 
-    double& operator[](const int i)
+    T& operator[](const int i)
     {
         assert(0 <= i && i < n);
         return data[i];
     }
 
-    const double& operator[](const int i) const
+    const T& operator[](const int i) const
     {
         assert(0 <= i && i < n);
         return data[i];
     }
+
+    template <typename U>
+    explicit operator vec<n, U>() const
+    {
+        vec<n, U> res;
+        for (int i{n}; i--; res[i] = static_cast<U>(data[i]));
+        return res;
+    }
 };
 
-template <int n>
-double operator*(const vec<n>& lhs, const vec<n>& rhs)
+template <int n, typename T>
+T operator*(const vec<n, T>& lhs, const vec<n, T>& rhs)
 {
-    double res{0};
+    T res{0};
     for (int i{n}; i--; res += lhs[i] * rhs[i]);
     return res;
 }
 
-template <int n>
-vec<n> operator+(const vec<n>& lhs, const vec<n>& rhs)
+template <int n, typename T>
+vec<n, T> operator+(const vec<n, T>& lhs, const vec<n, T>& rhs)
 {
-    vec<n> res{lhs};
+    vec<n, T> res{lhs};
     for (int i{n}; i--; res[i] += rhs[i]);
     return res;
 }
 
-template <int n>
-vec<n> operator-(const vec<n>& lhs, const vec<n>& rhs)
+template <int n, typename T>
+vec<n, T> operator-(const vec<n, T>& lhs, const vec<n, T>& rhs)
 {
-    vec<n> res{lhs};
+    vec<n, T> res{lhs};
     for (int i{n}; i--; res[i] -= rhs[i]);
     return res;
 }
 
-template <int n>
-vec<n> operator*(const vec<n>& lhs, const double& rhs)
+template <int n, typename T>
+vec<n, T> operator*(const vec<n, T>& lhs, const scalar<T>& rhs)
 {
-    vec<n> res{lhs};
+    vec<n, T> res{lhs};
     for (int i{n}; i--; res[i] *= rhs);
     return res;
 }
 
-template <int n>
-vec<n> operator*(const double& lhs, const vec<n>& rhs)
+template <int n, typename T>
+vec<n, T> operator*(const scalar<T>& lhs, const vec<n, T>& rhs)
 {
     return rhs * lhs;
 }
 
-template <int n>
-vec<n> operator/(const vec<n>& lhs, const double& rhs)
+template <int n, typename T>
+vec<n, T> operator/(const vec<n, T>& lhs, const scalar<T>& rhs)
 {
-    vec<n> res{lhs};
+    vec<n, T> res{lhs};
     for (int i{n}; i--; res[i] /= rhs);
     return res;
 }
 
-template <int n>
-std::ostream& operator<<(std::ostream& out, const vec<n>& v)
+template <int n, typename T>
+std::ostream& operator<<(std::ostream& out, const vec<n, T>& v)
 {
     for (int i{0}; i < n; ++i) out << v[i] << ' ';
     return out;
 }
 
-template <>
-struct vec<2>
+// The small vectors expose named components. operator[] indexes a table of
+// member pointers instead of a chain of branches: with a constant index it
+// folds to a plain member access, so unrolled component loops vectorize.
+template <typename T>
+struct vec<2, T>
 {
-    double x{0};
-    double y{0};
+    T x{0};
+    T y{0};
+
+    static constexpr T vec::*components[2]{&vec::x, &vec::y};
 
-    double& operator[](const int i)
+    T& operator[](const int i)
     {
         assert(0 <= i && i < 2);
-        return i ? y : x;
+        return this->*components[i];
     }
 
-    double operator[](const int i) const
+    T operator[](const int i) const
     {
         assert(0 <= i && i < 2);
-        return i ? y : x;
+        return this->*components[i];
+    }
+
+    template <typename U>
+    explicit operator vec<2, U>() const
+    {
+        return {static_cast<U>(x), static_cast<U>(y)};
     }
 };
 
-template <>
-struct vec<3>
+template <typename T>
+struct vec<3, T>
 {
-    double x{0};
-    double y{0};
-    double z{0};
+    T x{0};
+    T y{0};
+    T z{0};
 
-    double& operator[](const int i)
+    static constexpr T vec::*components[3]{&vec::x, &vec::y, &vec::z};
+
+    T& operator[](const int i)
     {
         assert(0 <= i && i < 3);
-        return i ? (i == 1 ? y : z) : x;
+        return this->*components[i];
     }
 
-    double operator[](const int i) const
+    T operator[](const int i) const
     {
         assert(0 <= i && i < 3);
-        return i ? (i == 1 ? y : z) : x;
+        return this->*components[i];
+    }
+
+    template <typename U>
+    explicit operator vec<3, U>() const
+    {
+        return {static_cast<U>(x), static_cast<U>(y), static_cast<U>(z)};
     }
 };
 
-template <>
-struct vec<4>
+template <typename T>
+struct vec<4, T>
 {
-    double x{0};
-    double y{0};
-    double z{0};
-    double w{0};
+    T x{0};
+    T y{0};
+    T z{0};
+    T w{0};
+
+    static constexpr T vec::*components[4]{&vec::x, &vec::y, &vec::z, &vec::w};
 
-    double& operator[](const int i)
+    T& operator[](const int i)
     {
         assert(0 <= i && i < 4);
-        return i < 2 ? (i ? y : x) : (i == 2 ? z : w);
+        return this->*components[i];
     }
 
-    double operator[](const int i) const
+    T operator[](const int i) const
     {
         assert(0 <= i && i < 4);
-        return i < 2 ? (i ? y : x) : (i == 2 ? z : w);
+        return this->*components[i];
+    }
+
+    template <typename U>
+    explicit operator vec<4, U>() const
+    {
+        return {static_cast<U>(x), static_cast<U>(y), static_cast<U>(z),
+                static_cast<U>(w)};
     }
 
-    vec<2> xy() const { return {x, y}; }
+    vec<2, T> xy() const { return {x, y}; }
 
-    vec<3> xyz() const { return {x, y, z}; }
+    vec<3, T> xyz() const { return {x, y, z}; }
 };
 
 typedef vec<2> vec2;
 typedef vec<3> vec3;
 typedef vec<4> vec4;
+typedef vec<2, double> dvec2;
+typedef vec<3, double> dvec3;
+typedef vec<4, double> dvec4;
 
-template <int n>
-double norm(const vec<n>& v)
+template <int n, typename T>
+T norm(const vec<n, T>& v)
 {
     return std::sqrt(v * v);
 }
 
-template <int n>
-vec<n> normalized(const vec<n>& v)
+template <int n, typename T>
+vec<n, T> normalized(const vec<n, T>& v)
 {
-    const double len{norm(v)};
+    const T len{norm(v)};
 
-    if (len == 0.0)
+    if (len == T(0))
         return v;
 
     return v / len;
 }
 
-inline vec3 cross(const vec3& v1, const vec3& v2)
+template <typename T>
+vec<3, T> cross(const vec<3, T>& v1, const vec<3, T>& v2)
 {
     return {v1.y * v2.z - v1.z * v2.y, v1.z * v2.x - v1.x * v2.z,
             v1.x * v2.y - v1.y * v2.x};
 }
 
-template <int n>
+template <int n, typename T>
 struct dt;
 
-template <int nrows, int ncols>
+template <int nrows, int ncols, typename T = real>
 struct mat
 {
-    vec<ncols> rows[nrows]{};
+    vec<ncols, T> rows[nrows]{};
 
-    vec<ncols>& operator[](const int idx)
+    vec<ncols, T>& operator[](const int idx)
     {
         assert(0 <= idx && idx < nrows);
         return rows[idx];
     }
 
-    const vec<ncols>& operator[](const int idx) const
+    const vec<ncols, T>& operator[](const int idx) const
     {
         assert(0 <= idx && idx < nrows);
         return rows[idx];
     }
 
-    double det() const { return dt<ncols>::det(*this); }
+    template <typename U>
+    explicit operator mat<nrows, ncols, U>() const
+    {
+        mat<nrows, ncols, U> res;
+        for (int i{nrows}; i--; res[i] = static_cast<vec<ncols, U>>(rows[i]));
+        return res;
+    }
+
+    T det() const { return dt<ncols, T>::det(*this); }
 
-    double cofactor(const int row, const int col) const
+    T cofactor(const int row, const int col) const
     {
-        mat<nrows - 1, ncols - 1> submatrix;
+        mat<nrows - 1, ncols - 1, T> submatrix;
 
         for (int i{nrows - 1}; i--;)
             for (int j{ncols - 1}; j--;
@@ -199,9 +262,9 @@ struct mat
         return submatrix.det() * ((row + col) % 2 ? -1 : 1);
     }
 
-    mat<nrows, ncols> invertTranspose() const
+    mat<nrows, ncols, T> invertTranspose() const
     {
-        mat<nrows, ncols> adjugateTranspose;
+        mat<nrows, ncols, T> adjugateTranspose;
 
         for (int i{nrows}; i--;)
             for (int j{ncols}; j--; adjugateTranspose[i][j] = cofactor(i, j));
@@ -209,11 +272,14 @@ struct mat
         return adjugateTranspose / (adjugateTranspose[0] * rows[0]);
     }
 
-    mat<nrows, ncols> invert() const { return invertTranspose().transpose(); }
+    mat<nrows, ncols, T> invert() const
+    {
+        return invertTranspose().transpose();
+    }
 
-    mat<ncols, nrows> transpose() const
+    mat<ncols, nrows, T> transpose() const
     {
-        mat<ncols, nrows> res;
+        mat<ncols, nrows, T> res;
 
         for (int i{ncols}; i--;)
             for (int j{nrows}; j--; res[i][j] = rows[j][i]);
@@ -222,24 +288,26 @@ struct mat
     }
 };
 
-template <int nrows, int ncols>
-vec<ncols> operator*(const vec<nrows>& lhs, const mat<nrows, ncols>& rhs)
+template <int nrows, int ncols, typename T>
+vec<ncols, T> operator*(const vec<nrows, T>& lhs,
+                        const mat<nrows, ncols, T>& rhs)
 {
-    return (mat<1, nrows>{{lhs}} * rhs)[0];
+    return (mat<1, nrows, T>{{lhs}} * rhs)[0];
 }
 
-template <int nrows, int ncols>
-vec<nrows> operator*(const mat<nrows, ncols>& lhs, const vec<ncols>& rhs)
+template <int nrows, int ncols, typename T>
+vec<nrows, T> operator*(const mat<nrows, ncols, T>& lhs,
+                        const vec<ncols, T>& rhs)
 {
-    vec<nrows> res;
+    vec<nrows, T> res;
     for (int i{nrows}; i--; res[i] = lhs[i] * rhs);
     return res;
 }
 
-template <int R1, int C1, int C2>
-mat<R1, C2> operator*(const mat<R1, C1>& lhs, const mat<C1, C2>& rhs)
+template <int R1, int C1, int C2, typename T>
+mat<R1, C2, T> operator*(const mat<R1, C1, T>& lhs, const mat<C1, C2, T>& rhs)
 {
-    mat<R1, C2> res;
+    mat<R1, C2, T> res;
 
     for (int i{R1}; i--;)
         for (int j{C2}; j--;)
@@ -248,27 +316,29 @@ mat<R1, C2> operator*(const mat<R1, C1>& lhs, const mat<C1, C2>& rhs)
     return res;
 }
 
-template <int nrows, int ncols>
-mat<nrows, ncols> operator*(const mat<nrows, ncols>& lhs, const double& val)
+template <int nrows, int ncols, typename T>
+mat<nrows, ncols, T> operator*(const mat<nrows, ncols, T>& lhs,
+                               const scalar<T>& val)
 {
-    mat<nrows, ncols> res;
+    mat<nrows, ncols, T> res;
     for (int i{nrows}; i--; res[i] = lhs[i] * val);
     return res;
 }
 
-template <int nrows, int ncols>
-mat<nrows, ncols> operator/(const mat<nrows, ncols>& lhs, const double& val)
+template <int nrows, int ncols, typename T>
+mat<nrows, ncols, T> operator/(const mat<nrows, ncols, T>& lhs,
+                               const scalar<T>& val)
 {
-    mat<nrows, ncols> res;
+    mat<nrows, ncols, T> res;
     for (int i{nrows}; i--; res[i] = lhs[i] / val);
     return res;
 }
 
-template <int nrows, int ncols>
-mat<nrows, ncols> operator+(const mat<nrows, ncols>& lhs,
-                            const mat<nrows, ncols>& rhs)
+template <int nrows, int ncols, typename T>
+mat<nrows, ncols, T> operator+(const mat<nrows, ncols, T>& lhs,
+                               const mat<nrows, ncols, T>& rhs)
 {
-    mat<nrows, ncols> res;
+    mat<nrows, ncols, T> res;
 
     for (int i{nrows}; i--;)
         for (int j{ncols}; j--; res[i][j] = lhs[i][j] + rhs[i][j]);
@@ -276,11 +346,11 @@ mat<nrows, ncols> operator+(const mat<nrows, ncols>& lhs,
     return res;
 }
 
-template <int nrows, int ncols>
-mat<nrows, ncols> operator-(const mat<nrows, ncols>& lhs,
-                            const mat<nrows, ncols>& rhs)
+template <int nrows, int ncols, typename T>
+mat<nrows, ncols, T> operator-(const mat<nrows, ncols, T>& lhs,
+                               const mat<nrows, ncols, T>& rhs)
 {
-    mat<nrows, ncols> res;
+    mat<nrows, ncols, T> res;
 
     for (int i{nrows}; i--;)
         for (int j{ncols}; j--; res[i][j] = lhs[i][j] - rhs[i][j]);
@@ -288,26 +358,26 @@ mat<nrows, ncols> operator-(const mat<nrows, ncols>& lhs,
     return res;
 }
 
-template <int nrows, int ncols>
-std::ostream& operator<<(std::ostream& out, const mat<nrows, ncols>& m)
+template <int nrows, int ncols, typename T>
+std::ostream& operator<<(std::ostream& out, const mat<nrows, ncols, T>& m)
 {
     for (int i{0}; i < nrows; ++i) out << m[i] << std::endl;
     return out;
 }
 
-template <int n>
+template <int n, typename T>
 struct dt
 {
-    static double det(const mat<n, n>& src)
+    static T det(const mat<n, n, T>& src)
     {
-        double res{0};
+        T res{0};
         for (int i{n}; i--; res += src[0][i] * src.cofactor(0, i));
         return res;
     }
 };
 
-template <>
-struct dt<1>
+template <typename T>
+struct dt<1, T>
 {
-    static double det(const mat<1, 1>& src) { return src[0][0]; }
+    static T det(const mat<1, 1, T>& src) { return src[0][0]; }
 };
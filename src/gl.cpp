@@ -1,9 +1,21 @@
 #include "gl.hpp"
 
 #include <algorithm>
+#include <cmath>
+#include <limits>
 
-mat<4, 4> ModelView, Viewport, Perspective;
-std::vector<double> zbuffer;
+#include "profile.hpp"
+#include "raster.hpp"
+
+mat<4, 4> ModelView, Perspective;
+mat<4, 4, double> Viewport;
+bool topLeftFill{false};
+bool depthOnly{false};
+std::uint32_t* visibilityIds{nullptr};
+std::uint32_t visibilityBase{0};
+DepthPyramid* occlusion{nullptr};
+Isa rasterIsa{detectIsa()};
+RowTest blockRowTest{rowTest(rasterIsa)};
 
 void lookAt(const vec3 eye, const vec3 center, const vec3 up)
 {
@@ -24,7 +36,7 @@ void lookAt(const vec3 eye, const vec3 center, const vec3 up)
 void initPerspective(const double f)
 {
     Perspective = {
-        {{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}, {0, 0, -1 / f, 1}}};
+        {{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}, {0, 0, real(-1 / f), 1}}};
 }
 
 void initViewport(const int x, const int y, const int w, const int h)
@@ -35,53 +47,243 @@ void initViewport(const int x, const int y, const int w, const int h)
                  {0, 0, 0, 1}}};
 }
 
-void initZBuffer(const int width, const int height)
+void initFillRule(const bool topLeft) { topLeftFill = topLeft; }
+
+void initDepthOnly(const bool enabled) { depthOnly = enabled; }
+
+void finishDepthPrepass(Framebuffer& framebuffer)
+{
+    constexpr double lowest{-std::numeric_limits<double>::infinity()};
+    double* const z{framebuffer.depth()};
+    double* const zmin{framebuffer.depthMin()};
+
+    for (int i{framebuffer.width() * framebuffer.height()}; i--;)
+        z[i] = std::nextafter(z[i], lowest);
+
+    for (int i{framebuffer.blockStride() * framebuffer.blockRows()}; i--;)
+        zmin[i] = std::nextafter(zmin[i], lowest);
+}
+
+void initVisibility(std::uint32_t* ids, const std::uint32_t base)
 {
-    zbuffer = std::vector(width * height, -1000.0);
+    visibilityIds = ids;
+    visibilityBase = base;
 }
 
-void rasterize(const Triangle& clip, const IShader& shader,
-               TGAImage& framebuffer)
+void initOcclusion(DepthPyramid* pyramid) { occlusion = pyramid; }
+
+void initIsa(const Isa isa)
 {
-    vec4 ndc[3]{clip[0] / clip[0].w, clip[1] / clip[1].w, clip[2] / clip[2].w};
-    vec2 screen[3] = {(Viewport * ndc[0]).xy(), (Viewport * ndc[1]).xy(),
-                      (Viewport * ndc[2]).xy()};
-    mat<3, 3> ABC = {{{screen[0].x, screen[0].y, 1.0},
+    rasterIsa = isa;
+    blockRowTest = rowTest(isa);
+}
+
+// With the top-left rule, coverage is decided by edge functions of the
+// vertices snapped to 1/256 pixel. Samples sit at integer pixels, so every
+// edge function value is an integer (in 1/256^2 pixel units); while snapped
+// coordinates stay below 2^24 every value and every sum the walkers form
+// stays below 2^53, and doubles hold them exactly. Two triangles sharing an
+// edge then get exactly opposite values along it, and excluding zero on
+// edges that are neither top nor left (bias 1) gives each sample on it to
+// one of them. Returns false when a vertex is too far out for this, and the
+// triangle is set up in floating point instead.
+static bool setupSnapped(const dvec2 screen[3], const dvec3& depth,
+                         const int width, const int height,
+                         TriangleSetup& setup, Cull& cull)
+{
+    constexpr double subpixels{256};
+    constexpr double limit{1 << 24};
+    double X[3], Y[3];
+
+    for (int i{3}; i--;)
+    {
+        X[i] = std::round(screen[i].x * subpixels);
+        Y[i] = std::round(screen[i].y * subpixels);
+
+        if (!(std::abs(X[i]) < limit && std::abs(Y[i]) < limit))
+            return false;
+    }
+
+    // The edge opposite vertex i runs from a = i + 1 to b = i + 2 with the
+    // interior on its left, as the triangle is counter-clockwise with y up.
+    // It is a left edge when it runs downwards and a top edge when it is
+    // flat and runs towards -x.
+    for (int i{3}; i--;)
+    {
+        const int a{(i + 1) % 3};
+        const int b{(i + 2) % 3};
+        const double ex{X[b] - X[a]};
+        const double ey{Y[b] - Y[a]};
+
+        setup.bcdx[i] = -ey * subpixels;
+        setup.bcdy[i] = ex * subpixels;
+        setup.bc0[i] = ey * X[a] - ex * Y[a];
+        setup.bias[i] = ey < 0 || (ey == 0 && ex < 0) ? 0.0 : 1.0;
+    }
+
+    // Twice the snapped area; the threshold matches the floating-point det.
+    const double area{setup.bc0[0] + setup.bc0[1] + setup.bc0[2]};
+
+    if (!(area > 0))
+    {
+        cull = Cull::Backface;
+        return true;
+    }
+
+    if (area < subpixels * subpixels)
+    {
+        cull = Cull::Small;
+        return true;
+    }
+
+    const auto [xmin, xmax] = std::minmax({X[0], X[1], X[2]});
+    const auto [ymin, ymax] = std::minmax({Y[0], Y[1], Y[2]});
+    const double bbminx{std::ceil(xmin / subpixels)};
+    const double bbmaxx{std::floor(xmax / subpixels)};
+    const double bbminy{std::ceil(ymin / subpixels)};
+    const double bbmaxy{std::floor(ymax / subpixels)};
+
+    if (bbminx > bbmaxx || bbminy > bbmaxy)
+    {
+        cull = Cull::Small;
+        return true;
+    }
+
+    setup.scale = 1 / area;
+    setup.zdx = setup.bcdx * depth * setup.scale;
+    setup.zdy = setup.bcdy * depth * setup.scale;
+    setup.z0 = setup.bc0 * depth * setup.scale;
+    setup.bbminx = static_cast<int>(std::max(bbminx, 0.0));
+    setup.bbminy = static_cast<int>(std::max(bbminy, 0.0));
+    setup.bbmaxx = static_cast<int>(std::min<double>(bbmaxx, width - 1));
+    setup.bbmaxy = static_cast<int>(std::min<double>(bbmaxy, height - 1));
+    cull = setup.bbminx <= setup.bbmaxx && setup.bbminy <= setup.bbmaxy
+               ? Cull::None
+               : Cull::Offscreen;
+    return true;
+}
+
+Cull setupTriangle(const int face, const Triangle& clip, const int width,
+                   const int height, TriangleSetup& setup)
+{
+    PROFILE_SUM(TriangleSetup);
+    dvec4 ndc[3];
+
+    for (int i{3}; i--;)
+        ndc[i] = static_cast<dvec4>(clip[i]) / static_cast<double>(clip[i].w);
+
+    dvec2 screen[3] = {(Viewport * ndc[0]).xy(), (Viewport * ndc[1]).xy(),
+                       (Viewport * ndc[2]).xy()};
+    const dvec3 depth{ndc[0].z, ndc[1].z, ndc[2].z};
+
+    setup.face = face;
+    setup.clipped = false;
+    setup.zmax = std::max({depth.x, depth.y, depth.z});
+
+    if (Cull cull;
+        topLeftFill && setupSnapped(screen, depth, width, height, setup, cull))
+        return cull;
+
+    mat<3, 3, double> ABC = {{{screen[0].x, screen[0].y, 1.0},
                       {screen[1].x, screen[1].y, 1.0},
                       {screen[2].x, screen[2].y, 1.0}}};
 
-    if (ABC.det() < 1)
-        return;
+    const double det{ABC.det()};
 
-    auto [bbminx, bbmaxx]{std::minmax({screen[0].x, screen[1].x, screen[2].x})};
-    auto [bbminy, bbmaxy]{std::minmax({screen[0].y, screen[1].y, screen[2].y})};
+    if (!(det > 0))
+        return Cull::Backface;
 
-#pragma omp parallel for
+    if (det < 1)
+        return Cull::Small;
 
-    for (int x{std::max<int>(bbminx, 0)};
-         x <= std::min<int>(bbmaxx, framebuffer.width() - 1); ++x)
-    {
-        for (int y{std::max<int>(bbminy, 0)};
-             y <= std::min<int>(bbmaxy, framebuffer.height() - 1); ++y)
-        {
-            vec3 bc{ABC.invertTranspose() *
-                    vec3{static_cast<double>(x), static_cast<double>(y), 1.0}};
+    auto [bbminx, bbmaxx] = std::minmax({screen[0].x, screen[1].x, screen[2].x});
+    auto [bbminy, bbmaxy] = std::minmax({screen[0].y, screen[1].y, screen[2].y});
 
-            if (bc.x < 0 || bc.y < 0 || bc.z < 0)
-                continue;
+    // Pixels are sampled at integer coordinates, so a bounding box without
+    // one holds no sample the triangle could cover.
+    if (std::ceil(bbminx) > bbmaxx || std::ceil(bbminy) > bbmaxy)
+        return Cull::Small;
 
-            double z{bc * vec3{ndc[0].z, ndc[1].z, ndc[2].z}};
+    const mat<3, 3, double> bc{ABC.invertTranspose()};
 
-            if (z <= zbuffer[x + y * framebuffer.width()])
-                continue;
+    setup.bcdx = {bc[0].x, bc[1].x, bc[2].x};
+    setup.bcdy = {bc[0].y, bc[1].y, bc[2].y};
+    setup.bc0 = {bc[0].z, bc[1].z, bc[2].z};
+    setup.scale = 1;
+    setup.zdx = setup.bcdx * depth;
+    setup.zdy = setup.bcdy * depth;
+    setup.z0 = setup.bc0 * depth;
+    setup.bias = {0, 0, 0};
+    setup.bbminx = std::max<int>(bbminx, 0);
+    setup.bbminy = std::max<int>(bbminy, 0);
+    setup.bbmaxx = std::min<int>(bbmaxx, width - 1);
+    setup.bbmaxy = std::min<int>(bbmaxy, height - 1);
 
-            auto [discard, color]{shader.fragment(bc)};
+    return setup.bbminx <= setup.bbmaxx && setup.bbminy <= setup.bbmaxy
+               ? Cull::None
+               : Cull::Offscreen;
+}
 
-            if (discard)
-                continue;
+bool triangleOccluded(const TriangleSetup& setup)
+{
+    if (!occlusion || !occlusion->occluded(setup.bbminx, setup.bbminy,
+                                           setup.bbmaxx, setup.bbmaxy,
+                                           setup.zmax))
+        return false;
+
+    ++occlusion->culledTriangles;
+    PROFILE_COUNT(TrianglesCulled, 1);
+    return true;
+}
 
-            zbuffer[x + y * framebuffer.width()] = z;
-            framebuffer.set(x, y, color);
-        }
+bool boxOccluded(const vec3 min, const vec3 max, const int width,
+                 const int height)
+{
+    if (!occlusion)
+        return false;
+
+    const mat<4, 4> mvp{Perspective * ModelView};
+    double x0{std::numeric_limits<double>::infinity()};
+    double y0{x0};
+    double x1{-x0};
+    double y1{-x0};
+    double zmax{-x0};
+
+    for (int corner{8}; corner--;)
+    {
+        const vec4 p{corner & 1 ? max.x : min.x, corner & 2 ? max.y : min.y,
+                     corner & 4 ? max.z : min.z, 1};
+        const dvec4 clip{static_cast<dvec4>(mvp * p)};
+
+        if (clip.w <= 0)
+            return false;
+
+        const dvec4 screen{Viewport * (clip / clip.w)};
+        x0 = std::min(x0, screen.x);
+        y0 = std::min(y0, screen.y);
+        x1 = std::max(x1, screen.x);
+        y1 = std::max(y1, screen.y);
+        zmax = std::max(zmax, screen.z);
     }
+
+    // Same pixel range as setupTriangle; boxes entirely off screen are left
+    // to the rasterizer.
+    const int bx0{std::max<int>(x0, 0)};
+    const int by0{std::max<int>(y0, 0)};
+    const int bx1{std::min<int>(x1, width - 1)};
+    const int by1{std::min<int>(y1, height - 1)};
+
+    if (bx0 > bx1 || by0 > by1 ||
+        !occlusion->occluded(bx0, by0, bx1, by1, zmax))
+        return false;
+
+    ++occlusion->culledMeshes;
+    return true;
 }
+
+// Virtual-dispatch instantiations shared by every caller holding an IShader.
+template void rasterizeRect<IShader>(const TriangleSetup&, const int, const int,
+                                     const int, const int, const IShader&,
+                                     Framebuffer&, const DepthView&);
+template void rasterize<IShader>(const TriangleSetup&, const IShader&,
+                                 Framebuffer&, const int);
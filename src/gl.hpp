@@ -1,24 +1,199 @@
 #pragma once
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+#include "framebuffer.hpp"
 #include "geometry.hpp"
+#include "hiz.hpp"
+#include "simd.hpp"
+#include "texture.hpp"
 #include "tgaimage.hpp"
 
 void lookAt(const vec3 eye, const vec3 center, const vec3 up);
 void initPerspective(const double f);
 void initViewport(const int x, const int y, const int w, const int h);
-void initZBuffer(const int width, const int height);
+
+// With topLeft set, coverage is tested with exact fixed-point edge functions
+// (vertices snapped to 1/256 pixel) under the top-left rule, so a sample on
+// an edge shared by two triangles is covered by exactly one of them.
+void initFillRule(const bool topLeft);
+void initIsa(const Isa isa);
+
+// While depth-only is enabled, fragments that pass the depth test update the
+// z-buffer without running the shader or touching the framebuffer.
+void initDepthOnly(const bool enabled);
+
+// Ends a depth-only pass by lowering every stored depth by one ulp. Drawing
+// the same triangles again then shades exactly the fragment that won each
+// pixel in the prepass, since only it beats its own depth and it restores
+// the exact value for later ties. Assumes shaders never discard.
+void finishDepthPrepass(Framebuffer& framebuffer);
+
+// While ids is non-null, fragments that pass the depth test store
+// base + face in ids[x + y * width] instead of being shaded.
+void initVisibility(std::uint32_t* ids, const std::uint32_t base);
+
+// While pyramid is non-null, triangles and meshes it proves hidden are
+// rejected before rasterization and counted in it.
+void initOcclusion(DepthPyramid* pyramid);
+
+// Shaders keep values that depend only on per-draw state (matrices, light
+// direction) in a uniform block aligned to a cache line, refreshed once per
+// draw call instead of being recomputed for every fragment.
+constexpr std::size_t kCacheLineSize{64};
+
+// f sampled at n + 1 points over [0, 1] and linearly interpolated between
+// them, for shading terms that are costly to evaluate exactly, such as a
+// specular power. Arguments outside [0, 1] are clamped.
+template <int n>
+class LookupTable
+{
+   public:
+    template <typename F>
+    explicit LookupTable(F f)
+    {
+        for (int i{0}; i <= n; ++i) table[i] = f(real(i) / n);
+
+        table[n + 1] = table[n];
+    }
+
+    real operator()(const real x) const
+    {
+        const real t{std::clamp<real>(x, 0, 1) * n};
+        const int i{static_cast<int>(t)};
+        return table[i] + (table[i + 1] - table[i]) * (t - i);
+    }
+
+   private:
+    alignas(kCacheLineSize) real table[n + 2];
+};
+
+// Up to eight horizontally adjacent fragments of one triangle in SoA form:
+// lane k is pixel (x + k, y) and is live when bit k of mask is set. The
+// barycentrics are affine in screen space, so their derivatives bcdx and
+// bcdy are shared by every lane and give exact ddx/ddy of any attribute.
+struct FragmentPacket
+{
+    static constexpr int size{8};
+
+    int face;
+    int x, y;
+    unsigned mask;
+    alignas(32) real bc[3][size];
+    vec3 bcdx, bcdy;
+};
+
+// Screen-space derivatives of an attribute with vertex values a0, a1, a2.
+template <typename T>
+T ddx(const FragmentPacket& packet, const T& a0, const T& a1, const T& a2)
+{
+    return a0 * packet.bcdx[0] + a1 * packet.bcdx[1] + a2 * packet.bcdx[2];
+}
+
+template <typename T>
+T ddy(const FragmentPacket& packet, const T& a0, const T& a1, const T& a2)
+{
+    return a0 * packet.bcdy[0] + a1 * packet.bcdy[1] + a2 * packet.bcdy[2];
+}
 
 struct IShader
 {
-    static TGAColor sample2D(const TGAImage& img, const vec2& uvf)
+    static TGAColor sample2D(const Texture& texture, const vec2& uvf)
     {
-        return img.get(uvf[0] * img.width(), uvf[1] * img.height());
+        return texture.nearest(uvf);
     }
 
-    virtual std::pair<bool, TGAColor> fragment(const vec3 bar) const = 0;
+    virtual std::pair<bool, TGAColor> fragment(const int face,
+                                               const vec3 bar) const = 0;
 };
 
 typedef vec4 Triangle[3];
 
-void rasterize(const Triangle& clip, const IShader& shader,
-               TGAImage& framebuffer);
+// Screen-space state of a triangle that survived culling, computed once and
+// shared by every pixel (and every tile) it touches. Barycentrics and depth
+// are affine in screen space: bc(x, y) = bc0 + bcdx * x + bcdy * y, so a
+// walker only adds bcdx / zdx when stepping to the next pixel. A pixel is
+// covered when every bc[i] >= bias[i]. Without the top-left rule bc are the
+// barycentrics and bias is 0. With it, bc are the integer-valued fixed-point
+// edge functions, evaluated exactly, bias is 1 on the edges the rule
+// excludes, and bc * scale are the barycentrics.
+// A piece of a triangle clipped at the near plane covers pixels by its own
+// barycentrics, but is shaded with those of the whole face: remap[i] holds
+// the face's barycentrics at vertex i of the piece.
+struct TriangleSetup
+{
+    int face;
+    dvec3 bc0, bcdx, bcdy;
+    double scale;
+    double z0, zdx, zdy;
+    double zmax;
+    dvec3 bias;
+    int bbminx, bbminy, bbmaxx, bbmaxy;
+    bool clipped;
+    dvec3 remap[3];
+};
+
+// Why setupTriangle rejected a triangle: it faces away from the eye or has
+// no area, it is smaller than half a pixel or falls between pixel centres,
+// or its bounding box misses the framebuffer.
+enum class Cull
+{
+    None,
+    Backface,
+    Small,
+    Offscreen
+};
+
+// Projects a triangle whose vertices are all in front of the eye to the
+// screen and sets it up; returns Cull::None when it may cover pixels.
+Cull setupTriangle(const int face, const Triangle& clip, const int width,
+                   const int height, TriangleSetup& setup);
+
+// Barycentrics passed to the shader for edge values bc of setup, or for
+// their derivatives; the identity unless setup is in fixed point or a
+// clipped piece.
+inline dvec3 shadingBarycentrics(const TriangleSetup& setup, const dvec3& bc)
+{
+    const dvec3 b{bc * setup.scale};
+
+    if (!setup.clipped)
+        return b;
+
+    return setup.remap[0] * b[0] + setup.remap[1] * b[1] +
+           setup.remap[2] * b[2];
+}
+
+// Occlusion tests against the pyramid bound by initOcclusion; both pass
+// everything when none is bound. A triangle is tested over its bounding box
+// at its nearest vertex depth. A model-space box is projected with the
+// current transforms; boxes reaching behind the eye are never rejected.
+bool triangleOccluded(const TriangleSetup& setup);
+bool boxOccluded(const vec3 min, const vec3 max, const int width,
+                 const int height);
+
+// Window onto a depth buffer starting at pixel (x0, y0), which must be
+// 8-aligned. Besides one depth per pixel it keeps a conservative minimum per
+// 8x8 block so that blocks a triangle cannot win anywhere are skipped. Depth
+// only ever grows, so a stale minimum is still a valid lower bound. Rows are
+// read 8 pixels at a time, so the last row needs 7 entries of padding.
+struct DepthView
+{
+    static constexpr int blockSize{Framebuffer::depthBlockSize};
+
+    double* z;
+    double* zmin;
+    int x0, y0;
+    int stride, blockStride;
+
+    double& at(const int x, const int y) const
+    {
+        return z[(x - x0) + (y - y0) * stride];
+    }
+
+    double& blockMin(const int x, const int y) const
+    {
+        return zmin[(x - x0) / blockSize + (y - y0) / blockSize * blockStride];
+    }
+};
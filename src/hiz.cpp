@@ -0,0 +1,88 @@
+#include "hiz.hpp"
+
+#include <algorithm>
+
+void DepthPyramid::build(const Framebuffer& framebuffer)
+{
+    const int w0{framebuffer.blockStride()};
+    const int h0{framebuffer.blockRows()};
+
+    if (levels.empty() || levels[0].w != w0 || levels[0].h != h0)
+    {
+        std::size_t size{0};
+        levels.clear();
+
+        for (int w{w0}, h{h0};; w = (w + 1) / 2, h = (h + 1) / 2)
+        {
+            levels.push_back({w, h, size});
+            size += static_cast<std::size_t>(w) * h;
+
+            if (w == 1 && h == 1)
+                break;
+        }
+
+        cells.resize(size);
+    }
+
+    std::copy_n(framebuffer.depthMin(), w0 * h0, cells.begin());
+
+    // Odd edges reduce over the one or two cells that exist.
+    for (std::size_t level{1}; level < levels.size(); ++level)
+    {
+        const Level& src{levels[level - 1]};
+        const Level& dst{levels[level]};
+        const double* const s{&cells[src.offset]};
+        double* const d{&cells[dst.offset]};
+
+        for (int y{0}; y < dst.h; ++y)
+        {
+            const int y0{2 * y};
+            const int y1{std::min(2 * y + 1, src.h - 1)};
+
+            for (int x{0}; x < dst.w; ++x)
+            {
+                const int x0{2 * x};
+                const int x1{std::min(2 * x + 1, src.w - 1)};
+
+                d[x + y * dst.w] =
+                    std::min({s[x0 + y0 * src.w], s[x1 + y0 * src.w],
+                              s[x0 + y1 * src.w], s[x1 + y1 * src.w]});
+            }
+        }
+    }
+}
+
+bool DepthPyramid::occluded(const int x0, const int y0, const int x1,
+                            const int y1, const double zmax) const
+{
+    // Same slack as the rasterizer's block test, for the rounding in zmax.
+    constexpr double eps{1e-9};
+    constexpr int B{Framebuffer::depthBlockSize};
+
+    if (levels.empty())
+        return false;
+
+    int cx0{x0 / B};
+    int cy0{y0 / B};
+    int cx1{x1 / B};
+    int cy1{y1 / B};
+    std::size_t level{0};
+
+    while ((cx1 - cx0 > 1 || cy1 - cy0 > 1) && level + 1 < levels.size())
+    {
+        cx0 >>= 1;
+        cy0 >>= 1;
+        cx1 >>= 1;
+        cy1 >>= 1;
+        ++level;
+    }
+
+    const Level& l{levels[level]};
+
+    for (int y{cy0}; y <= cy1; ++y)
+        for (int x{cx0}; x <= cx1; ++x)
+            if (zmax + eps > cells[l.offset + x + y * l.w])
+                return false;
+
+    return true;
+}
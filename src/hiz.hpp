@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "framebuffer.hpp"
+
+// Hierarchical Z: a pyramid over the framebuffer's 8x8 block depth minima
+// where each level keeps, per cell, the farthest depth of the 2x2 cells
+// below it. Depth grows towards the eye, so the farthest value is the
+// minimum, and anything whose nearest depth does not beat every cell it
+// covers is hidden. A pyramid built earlier in the frame stays conservative,
+// since depth only grows while drawing.
+class DepthPyramid
+{
+   public:
+    // Triangles and meshes rejected since the counters were last reset.
+    long long culledTriangles{0};
+    long long culledMeshes{0};
+
+    // Rebuilds every level from the current block minima of framebuffer.
+    void build(const Framebuffer& framebuffer);
+
+    // Whether a primitive whose nearest depth is zmax and that lies inside
+    // the pixel rect [x0, x1] x [y0, y1] is hidden. The test reads the
+    // lowest level on which the rect spans at most 2x2 cells.
+    bool occluded(const int x0, const int y0, const int x1, const int y1,
+                  const double zmax) const;
+
+    void resetCounters() { culledTriangles = culledMeshes = 0; }
+
+   private:
+    struct Level
+    {
+        int w, h;
+        std::size_t offset;
+    };
+
+    std::vector<Level> levels{};
+    AlignedBuffer<double> cells{};
+};
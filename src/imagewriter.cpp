@@ -0,0 +1,300 @@
+#include "imagewriter.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "framebuffer.hpp"
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+namespace
+{
+
+// Bytes of row y counted from the top, R, G, B, A for each pixel.
+const std::uint8_t* topRow(const std::uint32_t* colors, const int width,
+                           const int height, const int y)
+{
+    return reinterpret_cast<const std::uint8_t*>(
+        colors + static_cast<std::size_t>(height - 1 - y) * width);
+}
+
+class TgaWriter final : public ImageWriter
+{
+   public:
+    ImageFormat format() const override { return ImageFormat::Tga; }
+
+    void encode(const std::uint32_t* colors, const int width,
+                const int height, std::vector<std::uint8_t>& out) override
+    {
+        if (image.width() != width || image.height() != height)
+            image = TGAImage(width, height, TGAImage::RGB);
+
+        Framebuffer::toImage(colors, image);
+        image.encodeTGA(out);
+    }
+
+   private:
+    TGAImage image{};
+};
+
+class RawWriter final : public ImageWriter
+{
+   public:
+    ImageFormat format() const override { return ImageFormat::Raw; }
+
+    void encode(const std::uint32_t* colors, const int width,
+                const int height, std::vector<std::uint8_t>& out) override
+    {
+        const std::size_t rowBytes{4 * static_cast<std::size_t>(width)};
+        out.resize(rowBytes * height);
+
+        for (int y{0}; y < height; ++y)
+        {
+            std::uint8_t* const d{&out[y * rowBytes]};
+            std::memcpy(d, topRow(colors, width, height, y), rowBytes);
+
+            for (int x{0}; x < width; ++x) d[4 * x + 3] = 255;
+        }
+    }
+};
+
+class PpmWriter final : public ImageWriter
+{
+   public:
+    ImageFormat format() const override { return ImageFormat::Ppm; }
+
+    void encode(const std::uint32_t* colors, const int width,
+                const int height, std::vector<std::uint8_t>& out) override
+    {
+        const std::string header{"P6\n" + std::to_string(width) + ' ' +
+                                 std::to_string(height) + "\n255\n"};
+        const std::size_t rowBytes{3 * static_cast<std::size_t>(width)};
+        out.resize(header.size() + rowBytes * height);
+        std::memcpy(out.data(), header.data(), header.size());
+
+        for (int y{0}; y < height; ++y)
+        {
+            const std::uint8_t* s{topRow(colors, width, height, y)};
+            std::uint8_t* d{&out[header.size() + y * rowBytes]};
+
+            for (int x{0}; x < width; ++x, s += 4, d += 3)
+            {
+                d[0] = s[0];
+                d[1] = s[1];
+                d[2] = s[2];
+            }
+        }
+    }
+};
+
+// Follows the reference encoder of the QOI specification, with 3 channels
+// and every pixel opaque.
+class QoiWriter final : public ImageWriter
+{
+   public:
+    ImageFormat format() const override { return ImageFormat::Qoi; }
+
+    void encode(const std::uint32_t* colors, const int width,
+                const int height, std::vector<std::uint8_t>& out) override
+    {
+        constexpr std::uint8_t opIndex{0x00};
+        constexpr std::uint8_t opDiff{0x40};
+        constexpr std::uint8_t opLuma{0x80};
+        constexpr std::uint8_t opRun{0xc0};
+        constexpr std::uint8_t opRgb{0xfe};
+        constexpr std::uint8_t end[8]{0, 0, 0, 0, 0, 0, 0, 1};
+        const std::size_t npixels{static_cast<std::size_t>(width) * height};
+
+        // An RGB op, 4 bytes, is the longest a pixel can take.
+        out.resize(14 + 4 * npixels + sizeof(end));
+
+        std::uint8_t* p{out.data()};
+        const auto put32{[&p](const std::uint32_t v)
+                         {
+                             for (int shift{24}; shift >= 0; shift -= 8)
+                                 *p++ = static_cast<std::uint8_t>(v >> shift);
+                         }};
+
+        *p++ = 'q';
+        *p++ = 'o';
+        *p++ = 'i';
+        *p++ = 'f';
+        put32(width);
+        put32(height);
+        *p++ = 3;
+        *p++ = 0;
+
+        std::uint8_t index[64][3]{};
+        bool indexed[64]{};
+        std::uint8_t prev[3]{0, 0, 0};
+        int run{0};
+
+        for (int y{0}; y < height; ++y)
+        {
+            const std::uint8_t* px{topRow(colors, width, height, y)};
+
+            for (int x{0}; x < width; ++x, px += 4)
+            {
+                if (px[0] == prev[0] && px[1] == prev[1] && px[2] == prev[2])
+                {
+                    if (++run == 62)
+                    {
+                        *p++ = opRun | (run - 1);
+                        run = 0;
+                    }
+
+                    continue;
+                }
+
+                if (run)
+                {
+                    *p++ = opRun | (run - 1);
+                    run = 0;
+                }
+
+                const int hash{
+                    (px[0] * 3 + px[1] * 5 + px[2] * 7 + 255 * 11) % 64};
+
+                if (indexed[hash] && std::memcmp(index[hash], px, 3) == 0)
+                {
+                    *p++ = opIndex | hash;
+                }
+                else
+                {
+                    std::memcpy(index[hash], px, 3);
+                    indexed[hash] = true;
+
+                    // Differences wrap around, as bytes do.
+                    const int dr{static_cast<std::int8_t>(px[0] - prev[0])};
+                    const int dg{static_cast<std::int8_t>(px[1] - prev[1])};
+                    const int db{static_cast<std::int8_t>(px[2] - prev[2])};
+                    const int drg{dr - dg};
+                    const int dbg{db - dg};
+
+                    if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 &&
+                        db >= -2 && db <= 1)
+                    {
+                        *p++ = opDiff | (dr + 2) << 4 | (dg + 2) << 2 |
+                               (db + 2);
+                    }
+                    else if (dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7 &&
+                             dbg >= -8 && dbg <= 7)
+                    {
+                        *p++ = opLuma | (dg + 32);
+                        *p++ = (drg + 8) << 4 | (dbg + 8);
+                    }
+                    else
+                    {
+                        *p++ = opRgb;
+                        *p++ = px[0];
+                        *p++ = px[1];
+                        *p++ = px[2];
+                    }
+                }
+
+                std::memcpy(prev, px, 3);
+            }
+        }
+
+        if (run)
+            *p++ = opRun | (run - 1);
+
+        std::memcpy(p, end, sizeof(end));
+        out.resize(p + sizeof(end) - out.data());
+    }
+};
+
+}  // namespace
+
+const char* imageFormatName(const ImageFormat format)
+{
+    switch (format)
+    {
+        case ImageFormat::Tga:
+            return "tga";
+        case ImageFormat::Raw:
+            return "raw";
+        case ImageFormat::Ppm:
+            return "ppm";
+        case ImageFormat::Qoi:
+            return "qoi";
+    }
+
+    return "?";
+}
+
+bool parseImageFormat(const std::string_view name, ImageFormat& format)
+{
+    for (ImageFormat f : {ImageFormat::Tga, ImageFormat::Raw,
+                          ImageFormat::Ppm, ImageFormat::Qoi})
+    {
+        if (name == imageFormatName(f))
+        {
+            format = f;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+std::unique_ptr<ImageWriter> makeImageWriter(const ImageFormat format)
+{
+    switch (format)
+    {
+        case ImageFormat::Raw:
+            return std::make_unique<RawWriter>();
+        case ImageFormat::Ppm:
+            return std::make_unique<PpmWriter>();
+        case ImageFormat::Qoi:
+            return std::make_unique<QoiWriter>();
+        default:
+            return std::make_unique<TgaWriter>();
+    }
+}
+
+bool writeBytes(const std::filesystem::path& filename,
+                const std::span<const std::uint8_t> bytes)
+{
+    if (filename == "-")
+    {
+#ifdef _WIN32
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+
+        if (std::fwrite(bytes.data(), 1, bytes.size(), stdout) !=
+                bytes.size() ||
+            std::fflush(stdout))
+        {
+            std::cerr << "Error writing to standard output\n";
+            return false;
+        }
+
+        return true;
+    }
+
+    std::ofstream out(filename, std::ios::binary);
+
+    if (!out)
+    {
+        std::cerr << "Cannot open file " << filename << '\n';
+        return false;
+    }
+
+    out.write(reinterpret_cast<const char*>(bytes.data()),
+              static_cast<std::streamsize>(bytes.size()));
+
+    if (!out)
+    {
+        std::cerr << "Error writing " << filename << '\n';
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <vector>
+
+// Output file formats for rendered frames. Tga is the RLE file that
+// TGAImage::writeTGAFile writes; Raw is bare RGBA bytes, 4 per pixel; Ppm is
+// binary P6 RGB; Qoi is the Quite OK Image format, lossless and encoded in
+// one pass over the pixels.
+enum class ImageFormat
+{
+    Tga,
+    Raw,
+    Ppm,
+    Qoi
+};
+
+const char* imageFormatName(const ImageFormat format);
+bool parseImageFormat(const std::string_view name, ImageFormat& format);
+
+// Encodes frames given as packed colors (Framebuffer::colors, row 0 at the
+// bottom) into one format. The formats other than TGA store rows top down
+// and opaque, so every file shows the image the right way up.
+class ImageWriter
+{
+   public:
+    virtual ~ImageWriter() = default;
+
+    // Its name is also the file name extension.
+    virtual ImageFormat format() const = 0;
+
+    // Replaces out with the encoded image.
+    virtual void encode(const std::uint32_t* colors, const int width,
+                        const int height, std::vector<std::uint8_t>& out) = 0;
+};
+
+std::unique_ptr<ImageWriter> makeImageWriter(const ImageFormat format);
+
+// Writes bytes to a file, or to standard output when filename is "-" so
+// that a sequence of frames can be piped to another program.
+bool writeBytes(const std::filesystem::path& filename,
+                std::span<const std::uint8_t> bytes);
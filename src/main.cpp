@@ -1,91 +1,945 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cstdlib>
 #include <ctime>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <numbers>
+#include <sstream>
+#include <string>
+#include <string_view>
 
+#include "assembly.hpp"
+#include "binner.hpp"
+#include "framewriter.hpp"
 #include "geometry.hpp"
 #include "gl.hpp"
+#include "imagewriter.hpp"
 #include "model.hpp"
+#include "phongshader.hpp"
+#include "profile.hpp"
+#include "raster.hpp"
 #include "tgaimage.hpp"
+#include "visibility.hpp"
 
-extern mat<4, 4> ModelView, Perspective;
-extern std::vector<double> zbuffer;
+extern Isa rasterIsa;
 
-struct PhongShader : IShader
+// Hides a shader's packet entry point so the block rasterizer falls back to
+// shading one fragment at a time.
+template <typename Shader>
+struct PerFragment final
 {
-    const Model& model;
-    vec4 l;
-    vec2 varyingUV[3];
+    const Shader& shader;
 
-    PhongShader(const vec3 light, const Model& m) : model(m)
+    std::pair<bool, TGAColor> fragment(const int face, const vec3 bar) const
     {
-        l = normalized(ModelView * vec4{light.x, light.y, light.z, 0.0});
+        return shader.fragment(face, bar);
     }
+};
+
+// Parses text repeatedly for about a second and reports the throughput.
+static void benchParse(const std::string_view name, const std::string_view text)
+{
+    ObjMesh mesh;
+    int reps{0};
+    std::chrono::duration<double> elapsed{0};
+
+    while (elapsed.count() < 1.0)
+    {
+        auto start{std::chrono::steady_clock::now()};
+
+        if (!parseObj(text, mesh))
+            return;
+
+        elapsed += std::chrono::steady_clock::now() - start;
+        ++reps;
+    }
+
+    const double mb{text.size() / double(1 << 20)};
+    std::cerr << "parse " << name << ": " << mb << " MB, "
+              << mesh.facesVert.size() / 3 << " triangles, "
+              << elapsed.count() * 1e3 / reps << " ms, "
+              << mb * reps / elapsed.count() << " MB/s" << std::endl;
+}
+
+// Encodes image as RLE TGA for about a second with each encoder and reports
+// the throughput over its raw RGB pixels.
+static void benchEncode(const TGAImage& image)
+{
+    const double mb{3.0 * image.width() * image.height() / (1 << 20)};
+    std::vector<std::uint8_t> bytes[2];
+
+    for (const bool serial : {true, false})
+    {
+        int reps{0};
+        std::chrono::duration<double> elapsed{0};
+
+        while (elapsed.count() < 1.0)
+        {
+            auto start{std::chrono::steady_clock::now()};
+            image.encodeTGA(bytes[serial], true, true, serial);
+            elapsed += std::chrono::steady_clock::now() - start;
+            ++reps;
+        }
+
+        std::cerr << "encode " << image.width() << 'x' << image.height()
+                  << (serial ? " serial: " : " parallel: ")
+                  << elapsed.count() * 1e3 / reps << " ms, "
+                  << mb * reps / elapsed.count() << " MB/s" << std::endl;
+    }
+
+    std::cerr << "  " << bytes[0].size() << " bytes, "
+              << (bytes[0] == bytes[1] ? "identical" : "DIFFERENT")
+              << std::endl;
+}
+
+// Encodes colors for about a second in each output format and reports the
+// cost per frame, the throughput over the raw RGB pixels and the size.
+static void benchFormats(const std::uint32_t* colors, const int width,
+                         const int height)
+{
+    const double mb{3.0 * width * height / (1 << 20)};
+    std::vector<std::uint8_t> bytes;
+
+    for (ImageFormat format : {ImageFormat::Tga, ImageFormat::Raw,
+                               ImageFormat::Ppm, ImageFormat::Qoi})
+    {
+        const std::unique_ptr<ImageWriter> writer{makeImageWriter(format)};
+        int reps{0};
+        std::chrono::duration<double> elapsed{0};
+
+        while (elapsed.count() < 1.0)
+        {
+            auto start{std::chrono::steady_clock::now()};
+            writer->encode(colors, width, height, bytes);
+            elapsed += std::chrono::steady_clock::now() - start;
+            ++reps;
+        }
+
+        std::cerr << "encode " << imageFormatName(format) << ": "
+                  << elapsed.count() * 1e3 / reps << " ms, "
+                  << mb * reps / elapsed.count() << " MB/s, " << bytes.size()
+                  << " bytes" << std::endl;
+    }
+}
+
+// One camera of a batch render: the model-view matrix, the eye it looks
+// from in model space, and the focal length of the perspective.
+struct View
+{
+    mat<4, 4> modelView;
+    vec3 eye;
+    real focal;
+};
+
+// Camera at eye looking at center, as lookAt and the single-frame render
+// set it up.
+static View lookAtView(const vec3 eye, const vec3 center, const vec3 up)
+{
+    lookAt(eye, center, up);
+    return {ModelView, eye, norm(eye - center)};
+}
+
+// Reads one view per line: "ex ey ez" looks from the eye at center, six
+// numbers give the eye and the point looked at, and sixteen give a
+// model-view matrix row by row with lookAt's convention (the point looked at
+// maps to the origin and the eye to (0, 0, focal)). Blank lines and lines
+// starting with # are skipped.
+static bool readViews(const std::string& filename, const vec3 center,
+                      const vec3 up, const real focal,
+                      std::vector<View>& views)
+{
+    std::ifstream in(filename);
+    std::string line;
+    int lineNumber{0};
 
-    virtual vec4 vertex(const int face, const int vert)
+    if (!in)
     {
-        varyingUV[vert] = model.uv(face, vert);
-        vec4 glPosition{ModelView * model.vert(face, vert)};
-        return Perspective * glPosition;
+        std::cerr << "Cannot open " << filename << std::endl;
+        return false;
     }
 
-    virtual std::pair<bool, TGAColor> fragment(const vec3 bar) const
+    while (std::getline(in, line))
     {
-        TGAColor glFragColor{{255, 255, 255, 255}};
+        ++lineNumber;
+        std::istringstream fields(line);
+        std::vector<real> v;
+
+        for (real x; fields >> x;) v.push_back(x);
 
-        vec2 uv{varyingUV[0] * bar[0] + varyingUV[1] * bar[1] +
-                varyingUV[2] * bar[2]};
-        vec4 n{normalized(ModelView.invertTranspose() * model.normal(uv))};
-        vec4 r{normalized(2 * n * (n * l) - l)};
+        if (v.empty() && (line.find_first_not_of(" \t\r") == line.npos ||
+                          line[line.find_first_not_of(" \t\r")] == '#'))
+            continue;
+
+        if (!fields.eof() || (v.size() != 3 && v.size() != 6 && v.size() != 16))
+        {
+            std::cerr << filename << ':' << lineNumber
+                      << ": expected 3, 6 or 16 numbers" << std::endl;
+            return false;
+        }
+
+        if (v.size() == 16)
+        {
+            mat<4, 4> m;
+
+            for (int i{16}; i--;) m[i / 4][i % 4] = v[i];
+
+            views.push_back({m, (m.invert() * vec4{0, 0, focal, 1}).xyz(),
+                             focal});
+        }
+        else
+            views.push_back(lookAtView(
+                {v[0], v[1], v[2]},
+                v.size() == 6 ? vec3{v[3], v[4], v[5]} : center, up));
+    }
+
+    return true;
+}
 
-        double ambient{0.3};
-        double diff{std::max(0.0, n * l)};
-        double spec{std::pow(std::max(r.z, 0.0), 35)};
+// Counts fragment shader invocations of the wrapped shader.
+struct CountingShader : IShader
+{
+    const IShader& shader;
+    mutable std::atomic<long long> fragments{0};
 
-        for (int channel : {0, 1, 2})
-            glFragColor[channel] *=
-                std::min(1.0, ambient + 0.4 * diff + 0.9 * spec);
+    CountingShader(const IShader& s) : shader(s) {}
 
-        return {false, glFragColor};
+    virtual std::pair<bool, TGAColor> fragment(const int face,
+                                               const vec3 bar) const
+    {
+        fragments.fetch_add(1, std::memory_order_relaxed);
+        return shader.fragment(face, bar);
     }
 };
 
+enum class Backend
+{
+    Immediate,
+    Binned
+};
+
 int main(int argc, char** argv)
 {
-    if (argc < 2)
+    Backend backend{Backend::Immediate};
+    int nthreads{maxThreads()};
+    bool scaling{false};
+    bool isaBench{false};
+    bool useCache{true};
+    bool convert{false};
+    bool parseBench{false};
+    bool meshReport{false};
+    bool depthPrepass{false};
+    bool countFragments{false};
+    bool visibility{false};
+    bool staticDispatch{true};
+    bool dispatchBench{false};
+    bool packets{true};
+    bool hiz{false};
+    bool cullStats{false};
+    bool encodeBench{false};
+    bool stream{false};
+    std::string profileFile;
+    std::string traceFile;
+    ImageFormat format{ImageFormat::Tga};
+    int turntable{0};
+    std::string viewsFile;
+    Texture::Filter filter{Texture::Filter::Nearest};
+    NormalMap::Format normalFormat{NormalMap::Format::Snorm10};
+    MeshOptimization optimization;
+    std::size_t syntheticMB{0};
+    std::vector<std::string> files;
+
+    for (int i{1}; i < argc; ++i)
+    {
+        const std::string_view arg{argv[i]};
+
+        if (arg == "--backend=immediate")
+            backend = Backend::Immediate;
+        else if (arg == "--backend=binned")
+            backend = Backend::Binned;
+        else if (arg.starts_with("--threads="))
+            nthreads = std::max(1, std::atoi(argv[i] + 10));
+        else if (arg == "--scaling")
+            scaling = true;
+        else if (arg == "--top-left")
+            initFillRule(true);
+        else if (arg == "--no-cache")
+            useCache = false;
+        else if (arg == "--convert")
+            convert = true;
+        else if (arg == "--optimize")
+            optimization.vertexCache = optimization.vertexFetch = true;
+        else if (arg == "--front-to-back")
+            optimization.frontToBack = true;
+        else if (arg == "--meshlets")
+            optimization.meshlets = true;
+        else if (arg == "--mesh-report")
+            meshReport = true;
+        else if (arg == "--depth-prepass")
+            depthPrepass = true;
+        else if (arg == "--dispatch=static")
+            staticDispatch = true;
+        else if (arg == "--dispatch=virtual")
+            staticDispatch = false;
+        else if (arg.starts_with("--filter=") &&
+                 parseFilter(arg.substr(9), filter))
+            continue;
+        else if (arg.starts_with("--normal-format=") &&
+                 parseNormalFormat(arg.substr(16), normalFormat))
+            continue;
+        else if (arg == "--no-packets")
+            packets = false;
+        else if (arg == "--dispatch-bench")
+            dispatchBench = true;
+        else if (arg == "--visibility")
+            visibility = true;
+        else if (arg == "--hiz")
+            hiz = true;
+        else if (arg.starts_with("--turntable="))
+            turntable = std::max(1, std::atoi(argv[i] + 12));
+        else if (arg.starts_with("--views="))
+            viewsFile = arg.substr(8);
+        else if (arg == "--cull-stats")
+            cullStats = true;
+        else if (arg == "--count-fragments")
+            countFragments = true;
+        else if (arg == "--parse-bench")
+            parseBench = true;
+        else if (arg.starts_with("--parse-bench-synthetic="))
+            syntheticMB = std::strtoull(argv[i] + 24, nullptr, 10);
+        else if (arg == "--encode-bench")
+            encodeBench = true;
+        else if (arg.starts_with("--format=") &&
+                 parseImageFormat(arg.substr(9), format))
+            continue;
+        else if (arg == "--stream")
+            stream = true;
+        else if (arg.starts_with("--profile="))
+            profileFile = arg.substr(10);
+        else if (arg.starts_with("--trace="))
+            traceFile = arg.substr(8);
+        else if (arg == "--isa-bench")
+            isaBench = true;
+        else if (Isa isa; arg.starts_with("--isa=") &&
+                          parseIsa(arg.substr(6), isa) && isaSupported(isa))
+            initIsa(isa);
+        else if (arg.starts_with("--"))
+        {
+            std::cerr << "Unknown or unsupported option " << arg << std::endl;
+            return 1;
+        }
+        else
+            files.emplace_back(arg);
+    }
+
+    if (syntheticMB)
+    {
+        benchParse("synthetic", syntheticObj(syntheticMB << 20));
+
+        if (files.empty())
+            return 0;
+    }
+
+    if (files.empty())
+    {
+        std::cerr << "Usage: " << argv[0] << " [options] obj/model.obj...\n"
+                  << "  --backend=immediate|binned  --threads=N  --scaling\n"
+                  << "  --top-left  --isa=scalar|portable|sse4.1|avx2"
+                     "  --isa-bench\n"
+                  << "  --no-cache  --convert  --parse-bench"
+                     "  --parse-bench-synthetic=MB\n"
+                  << "  --optimize  --front-to-back  --meshlets"
+                     "  --mesh-report\n"
+                  << "  --depth-prepass  --visibility  --count-fragments"
+                     "  --hiz  --cull-stats\n"
+                  << "  --dispatch=static|virtual  --dispatch-bench"
+                     "  --no-packets\n"
+                  << "  --filter=nearest|bilinear|trilinear"
+                     "  --normal-format=snorm10|octahedral\n"
+                  << "  --turntable=N  --views=FILE  --stream"
+                     "  --format=tga|raw|ppm|qoi  --encode-bench\n"
+                  << "  --profile=FILE  --trace=FILE" << std::endl;
+        return 1;
+    }
+
+    if ((!profileFile.empty() || !traceFile.empty()) && !profile::enabled)
     {
-        std::cerr << "Usage: " << argv[0] << " obj/model.obj" << std::endl;
+        std::cerr << "--profile and --trace need a build configured with "
+                     "-DRASTERIZER_PROFILE=ON"
+                  << std::endl;
         return 1;
     }
 
+    if (depthPrepass && visibility)
+    {
+        std::cerr << "--depth-prepass and --visibility are exclusive"
+                  << std::endl;
+        return 1;
+    }
+
+    if (parseBench)
+    {
+        for (const std::string& file : files)
+        {
+            MappedFile text(file);
+
+            if (text)
+                benchParse(file, {reinterpret_cast<const char*>(text.data()),
+                                  text.size()});
+        }
+
+        return 0;
+    }
+
+    if (convert)
+    {
+        for (const std::string& file : files)
+            if (!Model(file, false).writeCache(file))
+                return 1;
+
+        return 0;
+    }
+
     constexpr int width{800};
     constexpr int height{800};
 
     constexpr vec3 light{1, 1, 1};
-    constexpr vec3 eye{-1, 0, 2};
+    vec3 eye{-1, 0, 2};
     constexpr vec3 center{0, 0, 0};
     constexpr vec3 up{0, 1, 0};
 
+    optimization.eye = eye;
+
+    // A batch render goes through a list of views instead of the single
+    // fixed camera: a turntable orbits the eye about the up axis through
+    // center.
+    std::vector<View> views;
+
+    for (int frame{0}; frame < turntable; ++frame)
+    {
+        const real angle{2 * std::numbers::pi_v<real> * frame / turntable};
+        const vec3 k{normalized(up)};
+        const vec3 v{eye - center};
+        views.push_back(lookAtView(
+            center + v * std::cos(angle) + cross(k, v) * std::sin(angle) +
+                k * (k * v) * (1 - std::cos(angle)),
+            center, up));
+    }
+
+    if (!viewsFile.empty() &&
+        !readViews(viewsFile, center, up, norm(eye - center), views))
+        return 1;
+
     lookAt(eye, center, up);
     initPerspective(norm(eye - center));
     initViewport(width / 16, height / 16, width * 7 / 8, height * 7 / 8);
-    initZBuffer(width, height);
 
-    TGAImage framebuffer(width, height, TGAImage::RGB);
+    std::vector<Model> models;
+    std::vector<PhongShader> shaders;
+    models.reserve(files.size());
+    shaders.reserve(files.size());
 
-    for (int m{1}; m < argc; ++m)
+    for (const std::string& file : files)
     {
-        Model model(argv[m]);
-        PhongShader shader(light, model);
-        int nfaces{model.nfaces()};
+        models.emplace_back(file, useCache, optimization, normalFormat);
+        shaders.emplace_back(light, models.back(), filter);
+    }
 
-        for (int f{0}; f < nfaces; ++f)
+    Framebuffer framebuffer(width, height);
+    TileBinner binner(width, height);
+    PrimitiveAssembler assembler(width, height);
+    VisibilityBuffer visibilityBuffer(framebuffer);
+    DepthPyramid pyramid;
+    std::vector<vec4> transformed;
+
+    // The vertex stage binds the shader's uniforms for this draw, then shades
+    // each unique vertex of a model once into the transformed array.
+    std::vector<Meshlet> drawn;
+    std::vector<std::uint8_t> used;
+
+    // A model split into meshlets first culls them as a whole; only the
+    // vertices of the ones left are shaded, and only their triangles drawn.
+    // Other models draw all their triangles as a single run.
+    auto shadeVertices{
+        [&](PhongShader& shader, const int nthreads)
         {
-            Triangle clip{shader.vertex(f, 0), shader.vertex(f, 1),
-                          shader.vertex(f, 2)};
+            PROFILE_SCOPE(VertexStage);
+            const Model& model{shader.model};
+            const int nvertices{model.nvertices()};
+
+            shader.bindUniforms();
+            transformed.resize(nvertices);
+            drawn.clear();
+
+            if (model.meshlets().empty())
+            {
+                drawn.push_back(
+                    {0, static_cast<std::uint32_t>(model.nfaces())});
+
+#pragma omp parallel for num_threads(nthreads)
+
+                for (int v = 0; v < nvertices; ++v)
+                    transformed[v] = shader.vertex(v);
+
+                return;
+            }
+
+            assembler.bindView(eye);
+
+            for (const Meshlet& m : model.meshlets())
+            {
+                const vec3 r{m.radius, m.radius, m.radius};
 
-            rasterize(clip, shader, framebuffer);
+                if (!assembler.cull(m) &&
+                    !(hiz && boxOccluded(m.center - r, m.center + r, width,
+                                         height)))
+                    drawn.push_back(m);
+            }
+
+            const std::span<const std::uint32_t> indices{model.indexBuffer()};
+            used.assign(nvertices, 0);
+
+            for (const Meshlet& m : drawn)
+                for (std::uint32_t i{m.firstTriangle * 3};
+                     i < (m.firstTriangle + m.ntriangles) * 3; ++i)
+                    used[indices[i]] = 1;
+
+#pragma omp parallel for num_threads(nthreads)
+
+            for (int v = 0; v < nvertices; ++v)
+                if (used[v])
+                    transformed[v] = shader.vertex(v);
+        }};
+
+    // Immediate-mode draws refresh the depth pyramid every hizRefresh
+    // triangles so that a model can occlude its own later triangles; binned
+    // draws only write depth back when they flush.
+    constexpr int hizRefresh{256};
+
+    // Assembles the drawn triangles of the model from the transformed
+    // vertices through its index buffer, culls and clips them, and
+    // rasterizes what is left with fragmentShader. The rasterizer is
+    // instantiated for the shader's static type, so passing a PhongShader
+    // inlines its fragment stage while an IShader reference goes through the
+    // virtual call.
+    auto drawTriangles{
+        [&](const Model& model, const auto& fragmentShader,
+            const Backend backend, const int nthreads)
+        {
+            const std::uint32_t* const indices{model.indexBuffer().data()};
+            int assembled{0};
+
+            PROFILE_COUNT(TrianglesIn, model.nfaces());
+            assembler.bind(transformed);
+
+            for (const Meshlet& m : drawn)
+            {
+                for (int f = m.firstTriangle;
+                     f < static_cast<int>(m.firstTriangle + m.ntriangles);
+                     ++f, ++assembled)
+                {
+                    if (hiz && backend == Backend::Immediate && assembled &&
+                        assembled % hizRefresh == 0)
+                        pyramid.build(framebuffer);
+
+                    TriangleSetup pieces[2];
+                    const int npieces{
+                        assembler.assemble(f, &indices[f * 3], pieces)};
+                    PROFILE_COUNT(TrianglesCulled, npieces == 0);
+
+                    for (int p{0}; p < npieces; ++p)
+                    {
+                        if (backend == Backend::Binned)
+                            binner.submit(pieces[p]);
+                        else
+                            rasterize(pieces[p], fragmentShader, framebuffer,
+                                      nthreads);
+                    }
+                }
+            }
+
+            if (backend == Backend::Binned)
+                binner.flush(fragmentShader, framebuffer, nthreads);
+
+            // Triangles of the meshlets culled before the vertex stage.
+            PROFILE_COUNT(TrianglesCulled, model.nfaces() - assembled);
+            return model.nfaces();
+        }};
+
+    auto draw{[&](PhongShader& shader, const auto& fragmentShader,
+                  const Backend backend, const int nthreads)
+              {
+                  shadeVertices(shader, nthreads);
+                  return drawTriangles(shader.model, fragmentShader, backend,
+                                       nthreads);
+              }};
+
+    // With --hiz the pyramid is rebuilt from the depth drawn so far before
+    // each model, and the whole model is skipped when its bounds are hidden.
+    auto occluded{[&](const Model& model)
+                  {
+                      if (!hiz)
+                          return false;
+
+                      pyramid.build(framebuffer);
+                      const Bounds& box{model.bounds()};
+
+                      if (!boxOccluded(box.min, box.max, width, height))
+                          return false;
+
+                      PROFILE_COUNT(TrianglesIn, model.nfaces());
+                      PROFILE_COUNT(TrianglesCulled, model.nfaces());
+                      return true;
+                  }};
+
+    if (hiz)
+        initOcclusion(&pyramid);
+
+    long long fragments{0};
+    double resolveTime{0};
+
+    // With a depth prepass every model is first drawn depth-only, so the
+    // shading pass runs the fragment shader once per visible pixel. With a
+    // visibility buffer the models are only rasterized into triangle IDs and
+    // shading happens in one full-screen resolve pass at the end.
+    auto render{
+        [&](const Backend backend, const int nthreads)
+        {
+            PROFILE_SCOPE(Frame);
+            framebuffer.clear();
+            int ntriangles{0};
+            std::deque<CountingShader> counters;
+            pyramid.resetCounters();
+            assembler.stats = {};
+
+            if (depthPrepass)
+            {
+                initDepthOnly(true);
+
+                for (PhongShader& shader : shaders)
+                    if (!occluded(shader.model))
+                        draw(shader, shader, backend, nthreads);
+
+                initDepthOnly(false);
+                finishDepthPrepass(framebuffer);
+            }
+
+            if (visibility)
+                visibilityBuffer.begin();
+
+            for (PhongShader& shader : shaders)
+            {
+                // Hidden models still count towards the scene's triangles.
+                if (occluded(shader.model))
+                {
+                    ntriangles += shader.model.nfaces();
+                    continue;
+                }
+
+                const IShader& fragmentShader{
+                    countFragments
+                        ? static_cast<const IShader&>(
+                              counters.emplace_back(shader))
+                        : shader};
+
+                shadeVertices(shader, nthreads);
+
+                if (visibility)
+                    visibilityBuffer.addInstance(fragmentShader, transformed,
+                                                 shader.model.indexBuffer());
+
+                if (staticDispatch && !countFragments && packets)
+                    ntriangles += drawTriangles(shader.model, shader, backend,
+                                                nthreads);
+                else if (staticDispatch && !countFragments)
+                    ntriangles += drawTriangles(
+                        shader.model, PerFragment<PhongShader>{shader},
+                        backend, nthreads);
+                else
+                    ntriangles += drawTriangles(shader.model, fragmentShader,
+                                                backend, nthreads);
+            }
+
+            if (visibility)
+            {
+                PROFILE_SCOPE(Resolve);
+                auto start{std::chrono::steady_clock::now()};
+                visibilityBuffer.resolve(nthreads);
+                resolveTime = std::chrono::duration<double>(
+                                  std::chrono::steady_clock::now() - start)
+                                  .count();
+            }
+
+            fragments = 0;
+
+            for (const CountingShader& counter : counters)
+                fragments += counter.fragments;
+
+            PROFILE_COUNT(PixelsCovered,
+                          std::count_if(framebuffer.depth(),
+                                        framebuffer.depth() + width * height,
+                                        [](const double z)
+                                        { return z > Framebuffer::farDepth; }));
+            return ntriangles;
+        }};
+
+    if (meshReport)
+    {
+        const MeshOptimization variants[2]{{}, optimization};
+
+        for (const std::string& file : files)
+        {
+            for (const MeshOptimization& variant : variants)
+            {
+                Model model(file, false, variant, normalFormat);
+                PhongShader shader(light, model, filter);
+                CountingShader counter{shader};
+
+                framebuffer.clear();
+                draw(shader, counter, Backend::Immediate, nthreads);
+
+                const long long covered{std::count_if(
+                    framebuffer.depth(), framebuffer.depth() + width * height,
+                    [](const double z) { return z > Framebuffer::farDepth; })};
+
+                std::cerr << file
+                          << (variant.flags() ? " optimized" : " original")
+                          << ": ACMR "
+                          << acmr(model.indexBuffer(), model.nvertices())
+                          << ", overdraw "
+                          << double(counter.fragments) / std::max(1LL, covered)
+                          << " (" << counter.fragments << " fragments, "
+                          << covered << " pixels)" << std::endl;
+            }
         }
+
+        return 0;
+    }
+
+    auto timedRender{
+        [&](const Backend backend, const int nthreads)
+        {
+            auto start{std::chrono::steady_clock::now()};
+            int ntriangles{render(backend, nthreads)};
+            std::chrono::duration<double> elapsed{
+                std::chrono::steady_clock::now() - start};
+
+            std::cerr << (backend == Backend::Binned ? "binned" : "immediate")
+                      << ' ' << isaName(rasterIsa)
+                      << (!staticDispatch ? " virtual"
+                          : packets       ? " packet"
+                                          : " static")
+                      << " threads " << nthreads
+                      << ": " << ntriangles << " triangles in "
+                      << elapsed.count() * 1e3 << " ms, "
+                      << ntriangles / elapsed.count() << " tris/s" << std::endl;
+
+            if (visibility)
+                std::cerr << "  resolve " << resolveTime * 1e3 << " ms"
+                          << std::endl;
+
+            if (cullStats)
+            {
+                const AssemblyStats& s{assembler.stats};
+                std::cerr << "  assembly: " << s.triangles << " triangles, "
+                          << s.frustum << " outside the frustum, "
+                          << s.clipped << " clipped at the near plane, "
+                          << s.backface << " backfacing, " << s.small
+                          << " too small, " << s.emitted << " set up"
+                          << std::endl;
+
+                if (s.meshlets)
+                    std::cerr << "  meshlets: " << s.meshlets << ", "
+                              << s.meshletsFrustum << " outside the frustum, "
+                              << s.meshletsBackface << " backfacing"
+                              << std::endl;
+            }
+
+            if (hiz)
+                std::cerr << "  hiz culled " << pyramid.culledMeshes
+                          << " meshes or meshlets, " << pyramid.culledTriangles
+                          << " triangles" << std::endl;
+
+            if (countFragments)
+            {
+                const long long covered{std::count_if(
+                    framebuffer.depth(), framebuffer.depth() + width * height,
+                    [](const double z) { return z > Framebuffer::farDepth; })};
+
+                std::cerr << "  " << fragments << " fragments shaded for "
+                          << covered << " pixels, "
+                          << double(fragments) / std::max(1LL, covered)
+                          << " per pixel" << std::endl;
+            }
+
+            return elapsed.count();
+        }};
+
+    // Writes the profile reports asked for; returns false when one failed.
+    auto writeProfile{[&]
+                      {
+                          bool ok{true};
+
+                          if (!profileFile.empty())
+                              ok &= profile::writeSummary(profileFile);
+
+                          if (!traceFile.empty())
+                              ok &= profile::writeTrace(traceFile);
+
+                          return ok;
+                      }};
+
+    if (dispatchBench)
+    {
+        double elapsed[2];
+
+        for (const bool dispatch : {false, true})
+        {
+            staticDispatch = dispatch;
+            elapsed[dispatch] = std::numeric_limits<double>::infinity();
+
+            for (int rep{0}; rep < 5; ++rep)
+                elapsed[dispatch] = std::min(elapsed[dispatch],
+                                             timedRender(backend, nthreads));
+        }
+
+        std::cerr << "  static dispatch speedup x" << elapsed[0] / elapsed[1]
+                  << " (best of 5)" << std::endl;
+    }
+    else if (!views.empty())
+    {
+        // Models, framebuffer and every per-frame buffer are reused; each
+        // frame only clears them. The writer encodes frame N while frame
+        // N + 1 renders.
+        FrameWriter writer(width, height, format);
+        double renderTime{0};
+        auto start{std::chrono::steady_clock::now()};
+
+        for (std::size_t frame{0}; frame < views.size(); ++frame)
+        {
+            const View& view{views[frame]};
+            std::ostringstream filename;
+            filename << "assets/frame_" << std::setw(4) << std::setfill('0')
+                     << frame << '.' << imageFormatName(format);
+
+            ModelView = view.modelView;
+            initPerspective(view.focal);
+            eye = view.eye;
+
+            auto frameStart{std::chrono::steady_clock::now()};
+            render(backend, nthreads);
+            renderTime += std::chrono::duration<double>(
+                              std::chrono::steady_clock::now() - frameStart)
+                              .count();
+
+            writer.submit(framebuffer, stream ? "-" : filename.str());
+        }
+
+        const bool ok{writer.finish()};
+        const std::chrono::duration<double> elapsed{
+            std::chrono::steady_clock::now() - start};
+        const double frames{static_cast<double>(views.size())};
+
+        std::cerr << views.size() << " frames in " << elapsed.count()
+                  << " s, " << frames / elapsed.count() << " frames/s (render "
+                  << renderTime * 1e3 / frames << " ms/frame, write "
+                  << writer.busySeconds() * 1e3 / frames
+                  << " ms/frame in the background, of which "
+                  << imageFormatName(format) << " encoding "
+                  << writer.encodeSeconds() * 1e3 / frames << " ms)"
+                  << std::endl;
+
+        const bool profiled{writeProfile()};
+        return ok && profiled ? 0 : 1;
+    }
+    else if (isaBench)
+    {
+        const Isa selected{rasterIsa};
+        double base{0};
+        bool consistent{true};
+        long long culled[2]{-1, -1};
+
+        for (Isa isa : {Isa::Scalar, Isa::Portable, Isa::SSE41, Isa::AVX2})
+        {
+            if (!isaSupported(isa))
+                continue;
+
+            initIsa(isa);
+            double elapsed{timedRender(backend, nthreads)};
+
+            if (isa == Isa::Scalar)
+                base = elapsed;
+            else
+                std::cerr << "  speedup x" << base / elapsed << std::endl;
+
+            // Every instruction set writes the same depth, so occlusion
+            // culling must reject the same meshes and triangles.
+            if (hiz && culled[0] >= 0 &&
+                (culled[0] != pyramid.culledMeshes ||
+                 culled[1] != pyramid.culledTriangles))
+            {
+                std::cerr << "  hiz culling differs from the previous "
+                             "instruction set"
+                          << std::endl;
+                consistent = false;
+            }
+
+            culled[0] = pyramid.culledMeshes;
+            culled[1] = pyramid.culledTriangles;
+        }
+
+        initIsa(selected);
+        timedRender(backend, nthreads);
+
+        if (!consistent)
+            return 1;
+    }
+    else if (scaling)
+    {
+        double base{timedRender(backend, 1)};
+
+        for (int t{2}; t <= nthreads; ++t)
+        {
+            double elapsed{timedRender(backend, t)};
+            std::cerr << "  speedup x" << base / elapsed << std::endl;
+        }
+    }
+    else
+    {
+        timedRender(backend, nthreads);
+    }
+
+    if (encodeBench)
+    {
+        // The frame, and the frame tiled over 4K as a larger image.
+        const TGAImage image{framebuffer.toImage()};
+        TGAImage large(3840, 2160, TGAImage::RGB);
+
+        for (int y{0}; y < large.height(); ++y)
+            for (int x{0}; x < large.width(); ++x)
+                large.set(x, y, image.get(x % width, y % height));
+
+        benchEncode(image);
+        benchEncode(large);
+        benchFormats(framebuffer.colors(), width, height);
+    }
+
+    const std::string output{
+        stream ? "-"
+               : std::string{"assets/framebuffer."} + imageFormatName(format)};
+    bool written{false};
+
+    {
+        PROFILE_SCOPE(ImageWrite);
+        std::vector<std::uint8_t> bytes;
+        makeImageWriter(format)->encode(framebuffer.colors(), width, height,
+                                        bytes);
+        written = writeBytes(output, bytes);
     }
 
-    framebuffer.writeTGAFile("assets/framebuffer.tga");
-    return 0;
+    const bool profiled{writeProfile()};
+    return written && profiled ? 0 : 1;
 }
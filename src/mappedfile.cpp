@@ -0,0 +1,100 @@
+#include "mappedfile.hpp"
+
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::filesystem::path& filename)
+{
+#ifdef _WIN32
+    HANDLE file{CreateFileW(filename.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                            nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+                            nullptr)};
+
+    if (file == INVALID_HANDLE_VALUE)
+        return;
+
+    LARGE_INTEGER fileSize{};
+
+    if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0)
+    {
+        HANDLE mapping{
+            CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr)};
+
+        if (mapping)
+        {
+            ptr = static_cast<const std::uint8_t*>(
+                MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+            len = ptr ? static_cast<std::size_t>(fileSize.QuadPart) : 0;
+            CloseHandle(mapping);
+        }
+    }
+
+    CloseHandle(file);
+#else
+    const int fd{::open(filename.c_str(), O_RDONLY)};
+
+    if (fd < 0)
+        return;
+
+    struct stat st{};
+
+    if (::fstat(fd, &st) == 0 && st.st_size > 0)
+    {
+        void* p{::mmap(nullptr, static_cast<std::size_t>(st.st_size),
+                       PROT_READ, MAP_PRIVATE, fd, 0)};
+
+        if (p != MAP_FAILED)
+        {
+            ptr = static_cast<const std::uint8_t*>(p);
+            len = static_cast<std::size_t>(st.st_size);
+        }
+    }
+
+    ::close(fd);
+#endif
+}
+
+MappedFile::~MappedFile() { unmap(); }
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : ptr(std::exchange(other.ptr, nullptr)),
+      len(std::exchange(other.len, 0))
+{
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+    if (this != &other)
+    {
+        unmap();
+        ptr = std::exchange(other.ptr, nullptr);
+        len = std::exchange(other.len, 0);
+    }
+
+    return *this;
+}
+
+void MappedFile::unmap() noexcept
+{
+    if (!ptr)
+        return;
+
+#ifdef _WIN32
+    UnmapViewOfFile(ptr);
+#else
+    ::munmap(const_cast<std::uint8_t*>(ptr), len);
+#endif
+
+    ptr = nullptr;
+    len = 0;
+}
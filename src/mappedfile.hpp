@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+
+// Read-only memory mapping of a whole file. The mapping is released when the
+// object is destroyed; moving it keeps the mapped address unchanged.
+class MappedFile
+{
+   public:
+    MappedFile() = default;
+    explicit MappedFile(const std::filesystem::path& filename);
+    ~MappedFile();
+
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const std::uint8_t* data() const noexcept { return ptr; }
+    std::size_t size() const noexcept { return len; }
+    explicit operator bool() const noexcept { return ptr != nullptr; }
+
+   private:
+    const std::uint8_t* ptr{nullptr};
+    std::size_t len{0};
+
+    void unmap() noexcept;
+};
@@ -0,0 +1,401 @@
+#include "mesh.hpp"
+
+#include <algorithm>
+#include <limits>
+
+void buildVertexBuffer(std::span<const vec4> verts,
+                       std::span<const vec4> norms, std::span<const vec2> tex,
+                       std::span<const int> facesVert,
+                       std::span<const int> facesNorm,
+                       std::span<const int> facesTex,
+                       std::vector<Vertex>& vertices,
+                       std::vector<std::uint32_t>& indices)
+{
+    constexpr std::uint32_t kNone{std::numeric_limits<std::uint32_t>::max()};
+
+    // Unique vertices sharing a position are chained from first[position],
+    // so a lookup only compares the few uv/normal pairs seen for it.
+    std::vector<std::uint32_t> first(verts.size(), kNone);
+    std::vector<std::uint32_t> next;
+    std::vector<int> uvOf;
+    std::vector<int> normalOf;
+
+    vertices.clear();
+    indices.resize(facesVert.size());
+
+    for (std::size_t c{0}; c < facesVert.size(); ++c)
+    {
+        const int v{facesVert[c]};
+        const int t{facesTex[c]};
+        const int n{facesNorm[c]};
+        std::uint32_t idx{first[v]};
+
+        while (idx != kNone && (uvOf[idx] != t || normalOf[idx] != n))
+            idx = next[idx];
+
+        if (idx == kNone)
+        {
+            idx = static_cast<std::uint32_t>(vertices.size());
+            vertices.push_back({verts[v], norms[n], tex[t]});
+            next.push_back(first[v]);
+            uvOf.push_back(t);
+            normalOf.push_back(n);
+            first[v] = idx;
+        }
+
+        indices[c] = idx;
+    }
+}
+
+double acmr(std::span<const std::uint32_t> indices, const std::size_t nvertices,
+            const int cacheSize)
+{
+    if (indices.empty())
+        return 0;
+
+    // A vertex is cached while fewer than cacheSize misses have happened
+    // since it was loaded, which is exactly FIFO replacement.
+    std::vector<std::size_t> loadedAt(nvertices, 0);
+    std::size_t misses{0};
+
+    for (const std::uint32_t v : indices)
+    {
+        if (loadedAt[v] && misses + 1 - loadedAt[v] < std::size_t(cacheSize))
+            continue;
+
+        loadedAt[v] = ++misses;
+    }
+
+    return static_cast<double>(misses) / (indices.size() / 3);
+}
+
+std::vector<std::uint32_t> tipsify(std::span<const std::uint32_t> indices,
+                                   const std::size_t nvertices,
+                                   const int cacheSize)
+{
+    const std::size_t ntris{indices.size() / 3};
+
+    // Vertex to triangle adjacency in compressed rows, and the number of
+    // triangles still to be emitted around each vertex.
+    std::vector<std::uint32_t> start(nvertices + 1, 0);
+    std::vector<std::uint32_t> live(nvertices, 0);
+
+    for (const std::uint32_t v : indices) ++live[v];
+
+    for (std::size_t v{0}; v < nvertices; ++v)
+        start[v + 1] = start[v] + live[v];
+
+    std::vector<std::uint32_t> adjacency(indices.size());
+    std::vector<std::uint32_t> fill(start.begin(), start.end() - 1);
+
+    for (std::size_t i{0}; i < indices.size(); ++i)
+        adjacency[fill[indices[i]]++] = static_cast<std::uint32_t>(i / 3);
+
+    std::vector<std::size_t> cachedAt(nvertices, 0);
+    std::vector<bool> emitted(ntris, false);
+    std::vector<std::uint32_t> deadEnd;
+    std::vector<std::uint32_t> candidates;
+    std::vector<std::uint32_t> order;
+    order.reserve(ntris);
+
+    std::size_t time{std::size_t(cacheSize) + 1};
+    std::size_t cursor{0};
+    std::int64_t fan{nvertices ? 0 : -1};
+
+    while (fan >= 0)
+    {
+        candidates.clear();
+
+        for (std::uint32_t a{start[fan]}; a < start[fan + 1]; ++a)
+        {
+            const std::uint32_t t{adjacency[a]};
+
+            if (emitted[t])
+                continue;
+
+            emitted[t] = true;
+            order.push_back(t);
+
+            for (int k{0}; k < 3; ++k)
+            {
+                const std::uint32_t v{indices[t * 3 + k]};
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                --live[v];
+
+                if (time - cachedAt[v] > std::size_t(cacheSize))
+                    cachedAt[v] = time++;
+            }
+        }
+
+        // Prefer the candidate that entered the cache earliest but will
+        // still be cached after its remaining triangles are emitted.
+        fan = -1;
+        std::int64_t best{-1};
+
+        for (const std::uint32_t v : candidates)
+        {
+            if (!live[v])
+                continue;
+
+            std::int64_t priority{0};
+
+            if (time - cachedAt[v] + 2 * live[v] <= std::size_t(cacheSize))
+                priority = static_cast<std::int64_t>(time - cachedAt[v]);
+
+            if (priority > best)
+            {
+                best = priority;
+                fan = v;
+            }
+        }
+
+        while (fan < 0 && !deadEnd.empty())
+        {
+            const std::uint32_t v{deadEnd.back()};
+            deadEnd.pop_back();
+
+            if (live[v])
+                fan = v;
+        }
+
+        for (; fan < 0 && cursor < nvertices; ++cursor)
+            if (live[cursor])
+                fan = static_cast<std::int64_t>(cursor);
+    }
+
+    return order;
+}
+
+void sortClustersFrontToBack(std::vector<std::uint32_t>& order,
+                             std::span<const std::uint32_t> indices,
+                             std::span<const Vertex> vertices, const vec3 eye,
+                             const int clusterSize)
+{
+    const std::size_t nclusters{(order.size() + clusterSize - 1) / clusterSize};
+    std::vector<std::pair<real, std::size_t>> keys(nclusters);
+
+    for (std::size_t c{0}; c < nclusters; ++c)
+    {
+        const std::size_t end{std::min(order.size(), (c + 1) * clusterSize)};
+        vec3 centroid{};
+
+        for (std::size_t i{c * clusterSize}; i < end; ++i)
+            for (int k{0}; k < 3; ++k)
+                centroid = centroid +
+                           vertices[indices[order[i] * 3 + k]].position.xyz();
+
+        centroid = centroid / real(3 * (end - c * clusterSize));
+        const vec3 d{centroid - eye};
+        keys[c] = {d * d, c};
+    }
+
+    std::stable_sort(keys.begin(), keys.end(),
+                     [](const auto& a, const auto& b)
+                     { return a.first < b.first; });
+
+    std::vector<std::uint32_t> sorted;
+    sorted.reserve(order.size());
+
+    for (const auto& [distance, c] : keys)
+        sorted.insert(sorted.end(), order.begin() + c * clusterSize,
+                      order.begin() + std::min(order.size(),
+                                               (c + 1) * clusterSize));
+
+    order = std::move(sorted);
+}
+
+std::vector<std::uint32_t> vertexFetchRemap(
+    std::span<const std::uint32_t> indices, const std::size_t nvertices)
+{
+    constexpr std::uint32_t kNone{std::numeric_limits<std::uint32_t>::max()};
+    std::vector<std::uint32_t> remap(nvertices, kNone);
+    std::uint32_t next{0};
+
+    for (const std::uint32_t v : indices)
+        if (remap[v] == kNone)
+            remap[v] = next++;
+
+    for (std::uint32_t& r : remap)
+        if (r == kNone)
+            r = next++;
+
+    return remap;
+}
+
+Bounds computeBounds(std::span<const Vertex> vertices)
+{
+    constexpr real inf{std::numeric_limits<real>::infinity()};
+    Bounds box{{inf, inf, inf}, {-inf, -inf, -inf}};
+
+    for (const Vertex& v : vertices)
+    {
+        for (int i{3}; i--;)
+        {
+            box.min[i] = std::min(box.min[i], v.position[i]);
+            box.max[i] = std::max(box.max[i], v.position[i]);
+        }
+    }
+
+    return box;
+}
+
+std::vector<Meshlet> buildMeshlets(std::span<const std::uint32_t> indices,
+                                   std::span<const Vertex> vertices,
+                                   std::vector<std::uint32_t>& order)
+{
+    const std::size_t ntris{indices.size() / 3};
+    const std::size_t nvertices{vertices.size()};
+
+    // Vertex to triangle adjacency in compressed rows, as in tipsify.
+    std::vector<std::uint32_t> start(nvertices + 1, 0);
+
+    for (const std::uint32_t v : indices) ++start[v + 1];
+
+    for (std::size_t v{0}; v < nvertices; ++v) start[v + 1] += start[v];
+
+    std::vector<std::uint32_t> adjacency(indices.size());
+    std::vector<std::uint32_t> fill(start.begin(), start.end() - 1);
+
+    for (std::size_t i{0}; i < indices.size(); ++i)
+        adjacency[fill[indices[i]]++] = static_cast<std::uint32_t>(i / 3);
+
+    auto position{[&](const std::size_t t, const int k)
+                  { return vertices[indices[t * 3 + k]].position.xyz(); }};
+
+    std::vector<vec3> normals(ntris);
+
+    for (std::size_t t{0}; t < ntris; ++t)
+        normals[t] = normalized(cross(position(t, 1) - position(t, 0),
+                                      position(t, 2) - position(t, 0)));
+
+    // Meshlet a vertex was last added to, numbered from 1.
+    std::vector<std::uint32_t> owner(nvertices, 0);
+    std::vector<bool> assigned(ntris, false);
+    std::vector<std::uint32_t> candidates;
+    std::vector<Meshlet> meshlets;
+    std::size_t seed{0};
+
+    order.clear();
+    order.reserve(ntris);
+
+    for (;;)
+    {
+        while (seed < ntris && assigned[seed]) ++seed;
+
+        if (seed == ntris)
+            break;
+
+        const std::uint32_t id{static_cast<std::uint32_t>(meshlets.size()) +
+                               1};
+        Meshlet m{static_cast<std::uint32_t>(order.size()), 0};
+        int nverts{0};
+        vec3 normalSum{};
+
+        candidates.assign(1, static_cast<std::uint32_t>(seed));
+
+        while (m.ntriangles < kMeshletTriangles)
+        {
+            const vec3 mean{normalized(normalSum)};
+            constexpr std::size_t none{~std::size_t{0}};
+            std::size_t best{none};
+            real bestScore{std::numeric_limits<real>::infinity()};
+
+            for (std::size_t c{0}; c < candidates.size();)
+            {
+                const std::uint32_t t{candidates[c]};
+
+                if (assigned[t])
+                {
+                    candidates[c] = candidates.back();
+                    candidates.pop_back();
+                    continue;
+                }
+
+                int added{0};
+
+                for (int k{0}; k < 3; ++k)
+                    added += owner[indices[t * 3 + k]] != id;
+
+                const real score{added - real(2) * (mean * normals[t])};
+
+                if (nverts + added <= kMeshletVertices && score < bestScore)
+                {
+                    best = c;
+                    bestScore = score;
+                }
+
+                ++c;
+            }
+
+            if (best == none)
+                break;
+
+            const std::uint32_t t{candidates[best]};
+            assigned[t] = true;
+            order.push_back(t);
+            ++m.ntriangles;
+            normalSum = normalSum + normals[t];
+
+            for (int k{0}; k < 3; ++k)
+            {
+                const std::uint32_t v{indices[t * 3 + k]};
+
+                if (owner[v] == id)
+                    continue;
+
+                owner[v] = id;
+                ++nverts;
+
+                for (std::uint32_t a{start[v]}; a < start[v + 1]; ++a)
+                    if (!assigned[adjacency[a]])
+                        candidates.push_back(adjacency[a]);
+            }
+        }
+
+        // Bounds: the sphere around the box of the vertices, and the cone
+        // around the mean normal out to the normal farthest from it.
+        constexpr real inf{std::numeric_limits<real>::infinity()};
+        vec3 lo{inf, inf, inf};
+        vec3 hi{-inf, -inf, -inf};
+
+        for (std::size_t i{m.firstTriangle}; i < order.size(); ++i)
+        {
+            for (int k{0}; k < 3; ++k)
+            {
+                const vec3 p{position(order[i], k)};
+
+                for (int j{3}; j--;)
+                {
+                    lo[j] = std::min(lo[j], p[j]);
+                    hi[j] = std::max(hi[j], p[j]);
+                }
+            }
+        }
+
+        m.center = (lo + hi) / real(2);
+        m.radius = 0;
+        m.axis = normalized(normalSum);
+        real minDot{1};
+
+        for (std::size_t i{m.firstTriangle}; i < order.size(); ++i)
+        {
+            for (int k{0}; k < 3; ++k)
+                m.radius =
+                    std::max(m.radius, norm(position(order[i], k) - m.center));
+
+            minDot = std::min(minDot, m.axis * normals[order[i]]);
+        }
+
+        m.cutoff = minDot > 0 ? std::sqrt(1 - minDot * minDot) : 1;
+        meshlets.push_back(m);
+    }
+
+    return meshlets;
+}
+
+bool backfacing(const Meshlet& meshlet, const vec3 eye)
+{
+    const vec3 d{meshlet.center - eye};
+    return d * meshlet.axis >= meshlet.cutoff * norm(d) + meshlet.radius;
+}
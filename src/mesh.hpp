@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "geometry.hpp"
+
+// One unique (position, uv, normal) combination of an indexed mesh.
+struct Vertex
+{
+    vec4 position;
+    vec4 normal;
+    vec2 uv;
+};
+
+// Deduplicates the corners of a mesh given as per-corner position, uv and
+// normal indices into a vertex buffer and a 32-bit index buffer with three
+// indices per triangle. Vertices keep the order of their first use.
+void buildVertexBuffer(std::span<const vec4> verts,
+                       std::span<const vec4> norms, std::span<const vec2> tex,
+                       std::span<const int> facesVert,
+                       std::span<const int> facesNorm,
+                       std::span<const int> facesTex,
+                       std::vector<Vertex>& vertices,
+                       std::vector<std::uint32_t>& indices);
+
+// Size of the FIFO post-transform cache that triangle reordering targets and
+// that acmr() simulates.
+constexpr int kVertexCacheSize{16};
+
+// Optional reordering applied to an indexed mesh when it is loaded.
+struct MeshOptimization
+{
+    // Reorder triangles for post-transform vertex cache locality (Tipsify).
+    bool vertexCache{false};
+    // Renumber vertices in order of first use so vertex fetch is linear.
+    bool vertexFetch{false};
+    // Sort clusters of consecutive triangles by distance to eye, nearest
+    // first, so that fewer occluded fragments are shaded.
+    bool frontToBack{false};
+    // Split the mesh into meshlets (see buildMeshlets), applied after the
+    // orders above.
+    bool meshlets{false};
+    vec3 eye{};
+
+    std::uint32_t flags() const
+    {
+        return vertexCache | vertexFetch << 1 | frontToBack << 2 |
+               meshlets << 3;
+    }
+};
+
+// Average cache miss ratio: vertex shader invocations per triangle when the
+// index buffer is fed through a FIFO cache of cacheSize entries.
+double acmr(std::span<const std::uint32_t> indices, const std::size_t nvertices,
+            const int cacheSize = kVertexCacheSize);
+
+// Returns a triangle order for the index buffer in the style of Tipsify
+// (Sander et al., "Fast Triangle Reordering for Vertex Locality and Reduced
+// Overdraw"): fan around the most recently cached vertex that still has
+// triangles left, so the order also forms spatially coherent clusters.
+std::vector<std::uint32_t> tipsify(std::span<const std::uint32_t> indices,
+                                   const std::size_t nvertices,
+                                   const int cacheSize = kVertexCacheSize);
+
+// Stable-sorts runs of clusterSize triangles of order by the distance from
+// eye to their centroid, nearest first.
+void sortClustersFrontToBack(std::vector<std::uint32_t>& order,
+                             std::span<const std::uint32_t> indices,
+                             std::span<const Vertex> vertices, const vec3 eye,
+                             const int clusterSize = 64);
+
+// Returns the new number of every vertex when vertices are renumbered in
+// order of first use by the index buffer. Unused vertices go last.
+std::vector<std::uint32_t> vertexFetchRemap(
+    std::span<const std::uint32_t> indices, const std::size_t nvertices);
+
+// Axis-aligned box around the positions of a mesh, in model space. Empty
+// meshes get a box with min > max.
+struct Bounds
+{
+    vec3 min, max;
+};
+
+Bounds computeBounds(std::span<const Vertex> vertices);
+
+// Largest meshlet buildMeshlets produces.
+constexpr int kMeshletTriangles{64};
+constexpr int kMeshletVertices{64};
+
+// Cluster of consecutive triangles of an index buffer, culled as a whole.
+// The sphere (center, radius) bounds its vertices. The normal cone holds
+// the unit normals of its triangles within acos(sqrt(1 - cutoff^2)) of
+// axis; a cutoff of 1 means they spread too far for a cone to help.
+struct Meshlet
+{
+    std::uint32_t firstTriangle;
+    std::uint32_t ntriangles;
+    vec3 center;
+    real radius;
+    vec3 axis;
+    real cutoff;
+};
+
+// Splits the mesh into meshlets of at most kMeshletTriangles triangles and
+// kMeshletVertices vertices. Each one grows from the first triangle left in
+// the current order over triangles sharing a vertex with it, preferring
+// those that add the fewest new vertices and, among them, those whose
+// normal is closest to its mean so the normal cone stays tight. order gets
+// the triangle order that makes every meshlet a consecutive run.
+std::vector<Meshlet> buildMeshlets(std::span<const std::uint32_t> indices,
+                                   std::span<const Vertex> vertices,
+                                   std::vector<std::uint32_t>& order);
+
+// Whether a viewer at eye sees only the back of every triangle of meshlet,
+// for any point inside its bounding sphere.
+bool backfacing(const Meshlet& meshlet, const vec3 eye);
@@ -1,88 +1,382 @@
 #include "model.hpp"
 
+#include <cstring>
 #include <fstream>
-#include <sstream>
 
-Model::Model(const std::string filename)
+#include "profile.hpp"
+
+namespace
 {
-    std::ifstream in;
-    in.open(filename, std::ifstream::in);
 
-    if (!in)
-        return;
+// Binary mesh cache, stored in native byte order. Each array starts at a
+// 64-byte aligned offset so the mapped file can be viewed in place.
+struct MeshHeader
+{
+    static constexpr char kMagic[4]{'R', 'M', 'S', 'H'};
+    static constexpr std::uint32_t kVersion{4};
+
+    char magic[4]{};
+    std::uint32_t version{0};
+    std::uint32_t scalarSize{0};
+    std::uint32_t nverts{0};
+    std::uint32_t nnorms{0};
+    std::uint32_t ntex{0};
+    std::uint32_t nfaces{0};
+    std::uint32_t nvertices{0};
+    std::uint32_t optimization{0};
+    std::uint32_t nmeshlets{0};
+    double eye[3]{0, 0, 0};
+    std::uint64_t sourceSize{0};
+    std::uint64_t sourceTime{0};
+    std::uint64_t verts{0};
+    std::uint64_t norms{0};
+    std::uint64_t tex{0};
+    std::uint64_t facesVert{0};
+    std::uint64_t facesNorm{0};
+    std::uint64_t facesTex{0};
+    std::uint64_t vertices{0};
+    std::uint64_t indices{0};
+    std::uint64_t meshlets{0};
+};
+
+constexpr std::uint64_t kCacheAlign{64};
+
+std::uint64_t alignUp(const std::uint64_t offset)
+{
+    return (offset + kCacheAlign - 1) & ~(kCacheAlign - 1);
+}
+
+bool sourceStamp(const std::filesystem::path& source, std::uint64_t& size,
+                 std::uint64_t& time)
+{
+    std::error_code ec;
+    size = std::filesystem::file_size(source, ec);
+
+    if (ec)
+        return false;
+
+    time = static_cast<std::uint64_t>(
+        std::filesystem::last_write_time(source, ec)
+            .time_since_epoch()
+            .count());
+
+    return !ec;
+}
 
-    std::string line;
+template <typename T>
+bool section(const MappedFile& file, const std::uint64_t offset,
+             const std::uint64_t count, std::span<const T>& out)
+{
+    if (offset % kCacheAlign || offset > file.size() ||
+        count > (file.size() - offset) / sizeof(T))
+        return false;
+
+    out = {reinterpret_cast<const T*>(file.data() + offset),
+           static_cast<std::size_t>(count)};
+    return true;
+}
+
+template <typename I>
+bool indicesInRange(const std::span<const I> indices, const std::size_t n)
+{
+    for (const I i : indices)
+        if (static_cast<std::size_t>(i) >= n)
+            return false;
+
+    return true;
+}
 
-    while (!in.eof())
+// Meshlets must tile the triangles in order, each with at least one.
+bool meshletsInRange(const std::span<const Meshlet> meshlets,
+                     const std::uint32_t nfaces)
+{
+    std::uint64_t next{0};
+
+    for (const Meshlet& m : meshlets)
     {
-        std::getline(in, line);
-        std::istringstream iss(line.c_str());
-        char trash;
+        if (m.firstTriangle != next || m.ntriangles == 0)
+            return false;
 
-        if (!line.compare(0, 2, "v "))
-        {
-            iss >> trash;
-            vec4 v{0, 0, 0, 1};
-            for (int i : {0, 1, 2}) iss >> v[i];
-            verts.push_back(v);
-        }
-        else if (!line.compare(0, 3, "vn "))
-        {
-            iss >> trash >> trash;
-            vec4 n;
-            for (int i : {0, 1, 2}) iss >> n[i];
-            norms.push_back(normalized(n));
-        }
-        else if (!line.compare(0, 3, "vt "))
-        {
-            iss >> trash >> trash;
-            vec2 uv;
-            for (int i : {0, 1}) iss >> uv[i];
-            tex.push_back({uv.x, 1 - uv.y});
-        }
-        else if (!line.compare(0, 2, "f "))
-        {
-            int f, t, n;
-            int cnt{0};
-
-            iss >> trash;
-
-            while (iss >> f >> trash >> t >> trash >> n)
-            {
-                facesVert.push_back(--f);
-                facesTex.push_back(--t);
-                facesNorm.push_back(--n);
-                ++cnt;
-            }
-
-            if (cnt != 3)
-            {
-                std::cerr
-                    << "Error: the obj file is supposed to be triangulated\n";
-                return;
-            }
-        }
+        next += m.ntriangles;
     }
 
-    std::cerr << "# v# " << nverts() << " f# " << nfaces() << std::endl;
+    return meshlets.empty() || next == nfaces;
+}
+
+}  // namespace
+
+Model::Model(const std::string filename, const bool useCache,
+             const MeshOptimization& optimization,
+             const NormalMap::Format normalFormat)
+    : optimization(optimization)
+{
+    if (!(useCache && loadCache(cachePath(filename), filename)))
+    {
+        if (!loadObj(filename))
+            return;
+
+        optimize();
+
+        if (useCache)
+            writeCache(filename);
+    }
+
+    box = computeBounds(vertices);
+
+    std::cerr << "# v# " << nverts() << " f# " << nfaces() << " u# "
+              << nvertices() << " vertex reuse "
+              << (nvertices() ? 3.0 * nfaces() / nvertices() : 0) << std::endl;
 
     auto loadTexture{
-        [&filename](const std::string suffix, TGAImage& img)
+        [&filename, normalFormat](const std::string suffix, NormalMap& map)
         {
+            PROFILE_SCOPE(TextureLoad);
             std::size_t dot{filename.find_last_of(".")};
 
             if (dot == std::string::npos)
                 return;
 
             std::string texFile{filename.substr(0, dot) + suffix};
+            TGAImage img;
+            const bool ok{img.readTGAFile(texFile.c_str())};
             std::cerr << "Texture file " << texFile << " loading "
-                      << (img.readTGAFile(texFile.c_str()) ? "ok" : "failed")
-                      << std::endl;
+                      << (ok ? "ok" : "failed") << std::endl;
+
+            if (ok)
+                map = NormalMap(Texture(img), normalFormat);
         }};
 
     loadTexture("_nm.tga", normalMap);
 }
 
+bool Model::loadObj(const std::string& filename)
+{
+    PROFILE_SCOPE(ObjLoad);
+    MappedFile file(filename);
+
+    if (!file ||
+        !parseObj({reinterpret_cast<const char*>(file.data()), file.size()},
+                  mesh))
+        return false;
+
+    verts = mesh.verts;
+    norms = mesh.norms;
+    tex = mesh.tex;
+    facesVert = mesh.facesVert;
+    facesNorm = mesh.facesNorm;
+    facesTex = mesh.facesTex;
+
+    buildVertexBuffer(verts, norms, tex, facesVert, facesNorm, facesTex,
+                      vertexData, indexData);
+    vertices = vertexData;
+    indices = indexData;
+    return true;
+}
+
+void Model::optimize()
+{
+    if (!optimization.flags())
+        return;
+
+    const std::size_t ntris{indexData.size() / 3};
+    std::vector<std::uint32_t> order(ntris);
+
+    for (std::size_t t{0}; t < ntris; ++t)
+        order[t] = static_cast<std::uint32_t>(t);
+
+    if (optimization.vertexCache)
+        order = tipsify(indexData, vertexData.size());
+
+    if (optimization.frontToBack)
+        sortClustersFrontToBack(order, indexData, vertexData,
+                                optimization.eye);
+
+    auto permute{[this, ntris](const std::vector<std::uint32_t>& order)
+                 {
+                     auto apply{[&](auto& corners)
+                                {
+                                    const auto src{corners};
+
+                                    for (std::size_t t{0}; t < ntris; ++t)
+                                        for (int k{0}; k < 3; ++k)
+                                            corners[t * 3 + k] =
+                                                src[order[t] * 3 + k];
+                                }};
+
+                     apply(indexData);
+                     apply(mesh.facesVert);
+                     apply(mesh.facesNorm);
+                     apply(mesh.facesTex);
+                 }};
+
+    permute(order);
+
+    if (optimization.meshlets)
+    {
+        meshletData = buildMeshlets(indexData, vertexData, order);
+        clusters = meshletData;
+        permute(order);
+    }
+
+    if (optimization.vertexFetch)
+    {
+        const std::vector<std::uint32_t> remap{
+            vertexFetchRemap(indexData, vertexData.size())};
+        const std::vector<Vertex> src{vertexData};
+
+        for (std::size_t v{0}; v < src.size(); ++v)
+            vertexData[remap[v]] = src[v];
+
+        for (std::uint32_t& i : indexData) i = remap[i];
+    }
+}
+
+std::filesystem::path Model::cachePath(const std::string& source)
+{
+    return std::filesystem::path(source).replace_extension(".mesh");
+}
+
+bool Model::loadCache(const std::filesystem::path& filename,
+                      const std::filesystem::path& source)
+{
+    PROFILE_SCOPE(MeshCacheLoad);
+    MappedFile file(filename);
+    MeshHeader header;
+
+    if (!file || file.size() < sizeof(header))
+        return false;
+
+    std::memcpy(&header, file.data(), sizeof(header));
+
+    std::uint64_t sourceSize{0};
+    std::uint64_t sourceTime{0};
+
+    if (std::memcmp(header.magic, MeshHeader::kMagic, sizeof(header.magic)) ||
+        header.version != MeshHeader::kVersion ||
+        header.scalarSize != sizeof(real) ||
+        !sourceStamp(source, sourceSize, sourceTime) ||
+        header.sourceSize != sourceSize || header.sourceTime != sourceTime ||
+        header.optimization != optimization.flags() ||
+        (optimization.frontToBack &&
+         (header.eye[0] != optimization.eye.x ||
+          header.eye[1] != optimization.eye.y ||
+          header.eye[2] != optimization.eye.z)))
+        return false;
+
+    const std::uint64_t nindices{std::uint64_t{header.nfaces} * 3};
+
+    if (!section(file, header.verts, header.nverts, verts) ||
+        !section(file, header.norms, header.nnorms, norms) ||
+        !section(file, header.tex, header.ntex, tex) ||
+        !section(file, header.facesVert, nindices, facesVert) ||
+        !section(file, header.facesNorm, nindices, facesNorm) ||
+        !section(file, header.facesTex, nindices, facesTex) ||
+        !section(file, header.vertices, header.nvertices, vertices) ||
+        !section(file, header.indices, nindices, indices) ||
+        !section(file, header.meshlets, header.nmeshlets, clusters) ||
+        !meshletsInRange(clusters, header.nfaces) ||
+        !indicesInRange(facesVert, verts.size()) ||
+        !indicesInRange(facesNorm, norms.size()) ||
+        !indicesInRange(facesTex, tex.size()) ||
+        !indicesInRange(indices, vertices.size()))
+    {
+        verts = {};
+        norms = {};
+        tex = {};
+        facesVert = {};
+        facesNorm = {};
+        facesTex = {};
+        vertices = {};
+        indices = {};
+        clusters = {};
+        std::cerr << "Ignoring malformed mesh cache " << filename << '\n';
+        return false;
+    }
+
+    cache = std::move(file);
+    std::cerr << "Mesh cache " << filename << " mapped" << std::endl;
+    return true;
+}
+
+bool Model::writeCache(const std::string& source) const
+{
+    const std::filesystem::path filename{cachePath(source)};
+    MeshHeader header;
+    std::memcpy(header.magic, MeshHeader::kMagic, sizeof(header.magic));
+    header.version = MeshHeader::kVersion;
+    header.scalarSize = sizeof(real);
+    header.nverts = static_cast<std::uint32_t>(verts.size());
+    header.nnorms = static_cast<std::uint32_t>(norms.size());
+    header.ntex = static_cast<std::uint32_t>(tex.size());
+    header.nfaces = static_cast<std::uint32_t>(nfaces());
+    header.nvertices = static_cast<std::uint32_t>(vertices.size());
+    header.nmeshlets = static_cast<std::uint32_t>(clusters.size());
+    header.optimization = optimization.flags();
+
+    for (int i{3}; i--;) header.eye[i] = optimization.eye[i];
+
+    if (!sourceStamp(source, header.sourceSize, header.sourceTime))
+        return false;
+
+    std::uint64_t offset{sizeof(header)};
+
+    auto place{[&offset](const std::uint64_t bytes)
+               {
+                   const std::uint64_t at{alignUp(offset)};
+                   offset = at + bytes;
+                   return at;
+               }};
+
+    header.verts = place(verts.size_bytes());
+    header.norms = place(norms.size_bytes());
+    header.tex = place(tex.size_bytes());
+    header.facesVert = place(facesVert.size_bytes());
+    header.facesNorm = place(facesNorm.size_bytes());
+    header.facesTex = place(facesTex.size_bytes());
+    header.vertices = place(vertices.size_bytes());
+    header.indices = place(indices.size_bytes());
+    header.meshlets = place(clusters.size_bytes());
+
+    std::filesystem::path tmp{filename};
+    tmp += ".tmp";
+    std::ofstream out(tmp, std::ios::binary);
+
+    auto write{[&out](const std::uint64_t at, const void* data,
+                      const std::size_t bytes)
+               {
+                   static constexpr char zeros[kCacheAlign]{};
+                   const std::uint64_t pos{
+                       static_cast<std::uint64_t>(out.tellp())};
+                   out.write(zeros, static_cast<std::streamsize>(at - pos));
+                   out.write(static_cast<const char*>(data),
+                             static_cast<std::streamsize>(bytes));
+               }};
+
+    write(0, &header, sizeof(header));
+    write(header.verts, verts.data(), verts.size_bytes());
+    write(header.norms, norms.data(), norms.size_bytes());
+    write(header.tex, tex.data(), tex.size_bytes());
+    write(header.facesVert, facesVert.data(), facesVert.size_bytes());
+    write(header.facesNorm, facesNorm.data(), facesNorm.size_bytes());
+    write(header.facesTex, facesTex.data(), facesTex.size_bytes());
+    write(header.vertices, vertices.data(), vertices.size_bytes());
+    write(header.indices, indices.data(), indices.size_bytes());
+    write(header.meshlets, clusters.data(), clusters.size_bytes());
+    out.close();
+
+    std::error_code ec;
+
+    if (!out || (std::filesystem::rename(tmp, filename, ec), ec))
+    {
+        std::filesystem::remove(tmp, ec);
+        std::cerr << "Cannot write mesh cache " << filename << '\n';
+        return false;
+    }
+
+    std::cerr << "Mesh cache " << filename << " written" << std::endl;
+    return true;
+}
+
 int Model::nverts() const { return verts.size(); }
 
 int Model::nfaces() const { return facesVert.size() / 3; }
@@ -101,13 +395,36 @@ vec4 Model::normal(const int iface, const int nthvert) const
 
 vec4 Model::normal(const vec2& uv) const
 {
-    TGAColor c{
-        normalMap.get(uv[0] * normalMap.width(), uv[1] * normalMap.height())};
-    return vec4{(double)c[2], (double)c[1], (double)c[0], 0} * 2.0 / 255.0 -
-           vec4{1, 1, 1, 0};
+    if (normalMap.empty())
+        return {-1, -1, -1, 0};
+
+    return normalMap.nearest(uv);
+}
+
+vec4 Model::normal(const vec2& uv, const real lod,
+                   const Texture::Filter filter) const
+{
+    if (normalMap.empty())
+        return {-1, -1, -1, 0};
+
+    return normalMap.sample(uv, lod, filter);
+}
+
+real Model::normalLod(const vec2& duvdx, const vec2& duvdy) const
+{
+    return normalMap.empty() ? 0 : normalMap.lod(duvdx, duvdy);
 }
 
 vec2 Model::uv(const int iface, const int nthvert) const
 {
     return tex[facesTex[iface * 3 + nthvert]];
 }
+
+int Model::nvertices() const { return vertices.size(); }
+
+const Vertex& Model::vertex(const int i) const { return vertices[i]; }
+
+std::uint32_t Model::index(const int iface, const int nthvert) const
+{
+    return indices[iface * 3 + nthvert];
+}
@@ -1,24 +1,83 @@
+#pragma once
+
+#include <filesystem>
+#include <span>
+
 #include "geometry.hpp"
-#include "tgaimage.hpp"
+#include "mappedfile.hpp"
+#include "mesh.hpp"
+#include "objparser.hpp"
+#include "normalmap.hpp"
 
 class Model
 {
    public:
-    Model(const std::string filename);
+    // Loads filename, preferring an up-to-date binary cache next to it (see
+    // cachePath) and writing one after parsing the OBJ when useCache is set.
+    // The mesh is reordered as requested by optimization; the cache records
+    // which reordering it holds and is only reused for the same one. The
+    // normal map is decoded into normalFormat.
+    Model(const std::string filename, const bool useCache = true,
+          const MeshOptimization& optimization = {},
+          const NormalMap::Format normalFormat = NormalMap::Format::Snorm10);
     int nverts() const;
     int nfaces() const;
     vec4 vert(const int i) const;
     vec4 vert(const int iface, const int nthvert) const;
     vec4 normal(const int iface, const int nthvert) const;
     vec4 normal(const vec2& uv) const;
+    // Normal map sampled with filter at mip level lod (trilinear only), and
+    // the level matching screen-space uv derivatives duvdx and duvdy.
+    vec4 normal(const vec2& uv, const real lod,
+                const Texture::Filter filter) const;
+    real normalLod(const vec2& duvdx, const vec2& duvdy) const;
     vec2 uv(const int iface, const int nthvert) const;
 
+    // Indexed view of the mesh: every distinct (position, uv, normal) corner
+    // is stored once, and faces refer to it through a 32-bit index buffer.
+    int nvertices() const;
+    const Vertex& vertex(const int i) const;
+    std::uint32_t index(const int iface, const int nthvert) const;
+    std::span<const std::uint32_t> indexBuffer() const { return indices; }
+
+    // Consecutive triangle runs culled as a whole; empty unless the model
+    // was loaded with MeshOptimization::meshlets.
+    std::span<const Meshlet> meshlets() const { return clusters; }
+
+    // Model-space box around every vertex.
+    const Bounds& bounds() const { return box; }
+
+    // Binary cache location for an OBJ file: the same path with a .mesh
+    // extension. writeCache stores the mesh there, stamped with the size and
+    // modification time of source so stale caches are ignored.
+    static std::filesystem::path cachePath(const std::string& source);
+    bool writeCache(const std::string& source) const;
+
    private:
-    TGAImage normalMap;
-    std::vector<vec4> verts{};
-    std::vector<vec4> norms{};
-    std::vector<vec2> tex{};
-    std::vector<int> facesVert{};
-    std::vector<int> facesNorm{};
-    std::vector<int> facesTex{};
+    NormalMap normalMap;
+    MeshOptimization optimization{};
+    Bounds box{};
+
+    // Mesh data is viewed through spans that point either into the arrays
+    // filled by the OBJ parser or straight into the mapped cache.
+    MappedFile cache{};
+    ObjMesh mesh{};
+    std::vector<Vertex> vertexData{};
+    std::vector<std::uint32_t> indexData{};
+    std::vector<Meshlet> meshletData{};
+
+    std::span<const vec4> verts{};
+    std::span<const vec4> norms{};
+    std::span<const vec2> tex{};
+    std::span<const int> facesVert{};
+    std::span<const int> facesNorm{};
+    std::span<const int> facesTex{};
+    std::span<const Vertex> vertices{};
+    std::span<const std::uint32_t> indices{};
+    std::span<const Meshlet> clusters{};
+
+    bool loadObj(const std::string& filename);
+    bool loadCache(const std::filesystem::path& filename,
+                   const std::filesystem::path& source);
+    void optimize();
 };
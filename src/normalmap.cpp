@@ -0,0 +1,65 @@
+#include "normalmap.hpp"
+
+#include <cmath>
+
+namespace
+{
+
+// Rounds v in [-1, 1] to a signed fixed-point value with the given number
+// of bits, returned in the low bits of the result.
+std::uint32_t snorm(const real v, const int bits)
+{
+    const int max{(1 << (bits - 1)) - 1};
+    const long q{std::lround(std::clamp<real>(v, -1, 1) * max)};
+    return static_cast<std::uint32_t>(q) & ((1u << bits) - 1);
+}
+
+}  // namespace
+
+NormalMap::NormalMap(const Texture& rgb, const Format format)
+    : format(format),
+      texture(rgb.transformed(
+          [format](const std::uint32_t t)
+          {
+              const vec4 c{Texture::bytes(t)};
+              const vec3 n{normalized(vec3{c[2], c[1], c[0]} * 2.0 / 255.0 -
+                                      vec3{1, 1, 1})};
+              return format == Format::Snorm10 ? encodeSnorm10(n)
+                                               : encodeOctahedral(n);
+          }))
+{
+}
+
+std::uint32_t NormalMap::encodeSnorm10(const vec3& n)
+{
+    return snorm(n.x, 10) | snorm(n.y, 10) << 10 | snorm(n.z, 10) << 20;
+}
+
+std::uint32_t NormalMap::encodeOctahedral(const vec3& n)
+{
+    const real l1{std::abs(n.x) + std::abs(n.y) + std::abs(n.z)};
+
+    if (l1 == 0)
+        return 0;
+
+    vec2 e{n.x / l1, n.y / l1};
+
+    // The lower hemisphere is folded over the diagonals of the square.
+    if (n.z < 0)
+        e = {(1 - std::abs(e.y)) * (e.x >= 0 ? 1 : -1),
+             (1 - std::abs(e.x)) * (e.y >= 0 ? 1 : -1)};
+
+    return snorm(e.x, 16) | snorm(e.y, 16) << 16;
+}
+
+bool parseNormalFormat(const std::string_view name, NormalMap::Format& format)
+{
+    if (name == "snorm10")
+        format = NormalMap::Format::Snorm10;
+    else if (name == "octahedral")
+        format = NormalMap::Format::Octahedral;
+    else
+        return false;
+
+    return true;
+}
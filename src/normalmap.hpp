@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+#include "geometry.hpp"
+#include "texture.hpp"
+
+// Tangent-free normal map decoded once at load time. Each texel of the RGB8
+// source (x in the red byte) is turned into a unit normal and packed into 32
+// bits, so a sample is a ready-to-use normal instead of bytes to rescale.
+// Snorm10 keeps x, y and z as 10-bit signed values and decodes with three
+// multiplies; Octahedral stores two snorm16 values on the octahedral map for
+// about twice the angular precision at the cost of a renormalization per
+// texel. Filtered samples are blends of unit normals and are not
+// renormalized.
+class NormalMap
+{
+   public:
+    enum class Format
+    {
+        Snorm10,
+        Octahedral
+    };
+
+    NormalMap() = default;
+    NormalMap(const Texture& rgb, const Format format);
+
+    bool empty() const noexcept { return texture.empty(); }
+
+    vec4 nearest(const vec2& uv) const
+    {
+        return format == Format::Snorm10
+                   ? texture.nearest(uv, decodeSnorm10)
+                   : texture.nearest(uv, decodeOctahedral);
+    }
+
+    vec4 sample(const vec2& uv, const real lod,
+                const Texture::Filter filter) const
+    {
+        return format == Format::Snorm10
+                   ? texture.sample(uv, lod, filter, decodeSnorm10)
+                   : texture.sample(uv, lod, filter, decodeOctahedral);
+    }
+
+    real lod(const vec2& duvdx, const vec2& duvdy) const
+    {
+        return texture.lod(duvdx, duvdy);
+    }
+
+    static std::uint32_t encodeSnorm10(const vec3& n);
+    static std::uint32_t encodeOctahedral(const vec3& n);
+
+    static vec4 decodeSnorm10(const std::uint32_t t)
+    {
+        constexpr real scale{real(1) / 511};
+        const std::int32_t s{static_cast<std::int32_t>(t)};
+        return {static_cast<real>(s << 22 >> 22) * scale,
+                static_cast<real>(s << 12 >> 22) * scale,
+                static_cast<real>(s << 2 >> 22) * scale, 0};
+    }
+
+    static vec4 decodeOctahedral(const std::uint32_t t)
+    {
+        const vec2 e{static_cast<std::int16_t>(t & 0xffff) / real(32767),
+                     static_cast<std::int16_t>(t >> 16) / real(32767)};
+        const real z{1 - std::abs(e.x) - std::abs(e.y)};
+        const real fold{std::max<real>(-z, 0)};
+        const vec4 n{e.x >= 0 ? e.x - fold : e.x + fold,
+                     e.y >= 0 ? e.y - fold : e.y + fold, z, 0};
+        return normalized(n);
+    }
+
+   private:
+    Format format{Format::Snorm10};
+    Texture texture{};
+};
+
+bool parseNormalFormat(const std::string_view name, NormalMap::Format& format);
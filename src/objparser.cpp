@@ -0,0 +1,397 @@
+#include "objparser.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+namespace
+{
+
+constexpr std::size_t kChunkSize{1 << 20};
+constexpr int kMissing{-1};
+
+enum class LineKind
+{
+    Vertex,
+    Normal,
+    Tex,
+    Face,
+    Other
+};
+
+struct ChunkCounts
+{
+    std::size_t verts{0};
+    std::size_t norms{0};
+    std::size_t tex{0};
+    std::size_t tris{0};
+};
+
+bool isSpace(const char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+const char* skipSpace(const char* p, const char* end)
+{
+    while (p < end && isSpace(*p)) ++p;
+    return p;
+}
+
+const char* skipToken(const char* p, const char* end)
+{
+    while (p < end && !isSpace(*p)) ++p;
+    return p;
+}
+
+const char* lineEnd(const char* p, const char* end)
+{
+    const void* nl{std::memchr(p, '\n', static_cast<std::size_t>(end - p))};
+    return nl ? static_cast<const char*>(nl) : end;
+}
+
+// Classifies the line at p and advances p past its keyword.
+LineKind classify(const char*& p, const char* end)
+{
+    if (end - p < 2)
+        return LineKind::Other;
+
+    if (p[0] == 'f' && isSpace(p[1]))
+    {
+        p += 2;
+        return LineKind::Face;
+    }
+
+    if (p[0] != 'v')
+        return LineKind::Other;
+
+    if (isSpace(p[1]))
+    {
+        p += 2;
+        return LineKind::Vertex;
+    }
+
+    if (end - p < 3 || !isSpace(p[2]))
+        return LineKind::Other;
+
+    p += 3;
+    return p[-2] == 'n'   ? LineKind::Normal
+           : p[-2] == 't' ? LineKind::Tex
+                          : LineKind::Other;
+}
+
+std::size_t countTokens(const char* p, const char* end)
+{
+    std::size_t n{0};
+
+    for (p = skipSpace(p, end); p < end; p = skipSpace(skipToken(p, end), end))
+        ++n;
+
+    return n;
+}
+
+ChunkCounts countChunk(const char* p, const char* end)
+{
+    ChunkCounts counts;
+
+    for (const char* eol; p < end; p = eol + 1)
+    {
+        eol = lineEnd(p, end);
+        const char* q{skipSpace(p, eol)};
+
+        switch (classify(q, eol))
+        {
+            case LineKind::Vertex:
+                ++counts.verts;
+                break;
+            case LineKind::Normal:
+                ++counts.norms;
+                break;
+            case LineKind::Tex:
+                ++counts.tex;
+                break;
+            case LineKind::Face:
+                counts.tris += std::max<std::size_t>(countTokens(q, eol), 2) - 2;
+                break;
+            case LineKind::Other:
+                break;
+        }
+    }
+
+    return counts;
+}
+
+// Reads up to n floats; returns how many were present.
+int parseFloats(const char* p, const char* end, real* out, const int n)
+{
+    int i{0};
+
+    for (p = skipSpace(p, end); i < n && p < end; p = skipSpace(p, end), ++i)
+    {
+        if (*p == '+')
+            ++p;
+
+        auto [next, ec]{std::from_chars(p, end, out[i])};
+
+        if (ec != std::errc{})
+            break;
+
+        p = next;
+    }
+
+    return i;
+}
+
+// Parses one "v[/t[/n]]" token, resolving indices against the number of
+// elements defined before this line. Absent references become kMissing.
+bool parseRef(const char*& p, const char* end, const ChunkCounts& seen,
+              const ChunkCounts& total, int ref[3])
+{
+    const std::size_t defined[3]{seen.verts, seen.tex, seen.norms};
+    const std::size_t limit[3]{total.verts, total.tex, total.norms};
+
+    for (int k{0}; k < 3; ++k)
+    {
+        ref[k] = kMissing;
+
+        if (k > 0)
+        {
+            if (p == end || *p != '/')
+                continue;
+
+            ++p;
+
+            if (p < end && *p == '/')
+                continue;
+        }
+
+        long long idx{0};
+        auto [next, ec]{std::from_chars(p, end, idx)};
+
+        if (ec != std::errc{} || idx == 0)
+            return false;
+
+        p = next;
+        idx = idx > 0 ? idx - 1 : static_cast<long long>(defined[k]) + idx;
+
+        if (idx < 0 || static_cast<std::size_t>(idx) >= limit[k])
+            return false;
+
+        ref[k] = static_cast<int>(idx);
+    }
+
+    return p == end || isSpace(*p);
+}
+
+struct ChunkResult
+{
+    const char* error{nullptr};
+    bool missingTex{false};
+    bool missingNorm{false};
+};
+
+ChunkResult parseChunk(const char* p, const char* end, ChunkCounts at,
+                       const ChunkCounts& total, ObjMesh& mesh)
+{
+    ChunkResult result;
+
+    for (const char* eol; p < end; p = eol + 1)
+    {
+        eol = lineEnd(p, end);
+        const char* q{skipSpace(p, eol)};
+        real v[3]{0, 0, 0};
+
+        switch (classify(q, eol))
+        {
+            case LineKind::Vertex:
+                if (parseFloats(q, eol, v, 3) != 3)
+                    return {p};
+
+                mesh.verts[at.verts++] = {v[0], v[1], v[2], 1};
+                break;
+            case LineKind::Normal:
+                if (parseFloats(q, eol, v, 3) != 3)
+                    return {p};
+
+                mesh.norms[at.norms++] = normalized(vec4{v[0], v[1], v[2], 0});
+                break;
+            case LineKind::Tex:
+                if (parseFloats(q, eol, v, 2) < 1)
+                    return {p};
+
+                mesh.tex[at.tex++] = {v[0], 1 - v[1]};
+                break;
+            case LineKind::Face:
+            {
+                int first[3];
+                int prev[3];
+                int cur[3];
+                int n{0};
+
+                for (q = skipSpace(q, eol); q < eol; q = skipSpace(q, eol), ++n)
+                {
+                    if (!parseRef(q, eol, at, total, cur))
+                        return {p};
+
+                    result.missingTex |= cur[1] == kMissing;
+                    result.missingNorm |= cur[2] == kMissing;
+
+                    if (n == 0)
+                        std::copy_n(cur, 3, first);
+
+                    if (n >= 2)
+                    {
+                        const std::size_t i{at.tris++ * 3};
+
+                        mesh.facesVert[i] = first[0];
+                        mesh.facesVert[i + 1] = prev[0];
+                        mesh.facesVert[i + 2] = cur[0];
+                        mesh.facesTex[i] = first[1];
+                        mesh.facesTex[i + 1] = prev[1];
+                        mesh.facesTex[i + 2] = cur[1];
+                        mesh.facesNorm[i] = first[2];
+                        mesh.facesNorm[i + 1] = prev[2];
+                        mesh.facesNorm[i + 2] = cur[2];
+                    }
+
+                    std::copy_n(cur, 3, prev);
+                }
+
+                if (n < 3)
+                    return {p};
+
+                break;
+            }
+            case LineKind::Other:
+                break;
+        }
+    }
+
+    return result;
+}
+
+// Points faces without a texture coordinate or normal at a default element.
+template <typename T>
+void fillMissing(std::vector<T>& values, std::vector<int>& indices,
+                 const T fallback)
+{
+    const int idx{static_cast<int>(values.size())};
+    values.push_back(fallback);
+    std::replace(indices.begin(), indices.end(), kMissing, idx);
+}
+
+}  // namespace
+
+bool parseObj(const std::string_view text, ObjMesh& mesh)
+{
+    const char* const begin{text.data()};
+    const char* const end{begin + text.size()};
+    std::vector<const char*> bounds{begin};
+
+    while (end - bounds.back() > static_cast<std::ptrdiff_t>(kChunkSize))
+        bounds.push_back(
+            std::min(lineEnd(bounds.back() + kChunkSize, end) + 1, end));
+
+    bounds.push_back(end);
+
+    const int nchunks{static_cast<int>(bounds.size()) - 1};
+    std::vector<ChunkCounts> offsets(nchunks + 1);
+
+#pragma omp parallel for schedule(dynamic)
+
+    for (int c = 0; c < nchunks; ++c)
+        offsets[c + 1] = countChunk(bounds[c], bounds[c + 1]);
+
+    for (int c{0}; c < nchunks; ++c)
+    {
+        offsets[c + 1].verts += offsets[c].verts;
+        offsets[c + 1].norms += offsets[c].norms;
+        offsets[c + 1].tex += offsets[c].tex;
+        offsets[c + 1].tris += offsets[c].tris;
+    }
+
+    const ChunkCounts total{offsets[nchunks]};
+    mesh.verts.resize(total.verts);
+    mesh.norms.resize(total.norms);
+    mesh.tex.resize(total.tex);
+    mesh.facesVert.resize(total.tris * 3);
+    mesh.facesNorm.resize(total.tris * 3);
+    mesh.facesTex.resize(total.tris * 3);
+
+    std::vector<ChunkResult> results(nchunks);
+
+#pragma omp parallel for schedule(dynamic)
+
+    for (int c = 0; c < nchunks; ++c)
+        results[c] = parseChunk(bounds[c], bounds[c + 1], offsets[c], total,
+                                mesh);
+
+    bool missingTex{false};
+    bool missingNorm{false};
+
+    for (const ChunkResult& result : results)
+    {
+        if (result.error)
+        {
+            const char* eol{lineEnd(result.error, end)};
+            std::cerr << "Error: malformed obj line "
+                      << std::count(begin, result.error, '\n') + 1 << ": "
+                      << std::string_view(result.error, eol - result.error)
+                      << '\n';
+            return false;
+        }
+
+        missingTex |= result.missingTex;
+        missingNorm |= result.missingNorm;
+    }
+
+    if (missingTex)
+        fillMissing(mesh.tex, mesh.facesTex, vec2{0, 0});
+
+    if (missingNorm)
+        fillMissing(mesh.norms, mesh.facesNorm, vec4{0, 0, 1, 0});
+
+    return true;
+}
+
+std::string syntheticObj(const std::size_t bytes)
+{
+    // Each grid vertex contributes one v, vt and vn line and one quad,
+    // about 175 bytes in total.
+    const int side{std::max(2, static_cast<int>(std::sqrt(bytes / 175.0)))};
+    std::string text;
+    text.reserve(bytes + bytes / 8);
+    char line[128];
+
+    auto append{[&text, &line](const int n) { text.append(line, n); }};
+
+    for (int y{0}; y < side; ++y)
+    {
+        for (int x{0}; x < side; ++x)
+        {
+            const double u{x / (side - 1.0)};
+            const double v{y / (side - 1.0)};
+            append(std::snprintf(line, sizeof(line), "v %.6f %.6f %.6f\n",
+                                 u * 2 - 1, v * 2 - 1, 0.25 * std::sin(u * 9)));
+            append(std::snprintf(line, sizeof(line), "vt %.6f %.6f\n", u, v));
+            append(std::snprintf(line, sizeof(line), "vn %.6f %.6f %.6f\n",
+                                 0.0, 0.0, 1.0));
+        }
+    }
+
+    for (int y{1}; y < side; ++y)
+    {
+        for (int x{1}; x < side; ++x)
+        {
+            const int a{(y - 1) * side + x};
+            const int b{a + 1};
+            const int c{b + side};
+            const int d{a + side};
+            append(std::snprintf(line, sizeof(line),
+                                 "f %d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d\n", a,
+                                 a, a, b, b, b, c, c, c, d, d, d));
+        }
+    }
+
+    return text;
+}
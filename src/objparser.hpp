@@ -0,0 +1,32 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "geometry.hpp"
+
+// Mesh arrays as read from an OBJ file. Faces are triangulated, and each face
+// index array holds three zero-based indices per triangle.
+struct ObjMesh
+{
+    std::vector<vec4> verts{};
+    std::vector<vec4> norms{};
+    std::vector<vec2> tex{};
+    std::vector<int> facesVert{};
+    std::vector<int> facesNorm{};
+    std::vector<int> facesTex{};
+};
+
+// Parses OBJ text into mesh. The text is cut into chunks at line boundaries
+// that are counted and then parsed in parallel straight into the final
+// arrays, so no memory is allocated per line or per chunk. Faces may be
+// polygons (fan-triangulated) with v, v/t, v//n or v/t/n references and
+// negative (relative) indices. Faces without texture coordinates or normals
+// point at a default entry appended to tex or norms. On failure the error is
+// reported on std::cerr and false is returned.
+bool parseObj(const std::string_view text, ObjMesh& mesh);
+
+// Generates roughly the requested number of bytes of OBJ text: a grid of
+// vertices with texture coordinates and normals, joined by quads.
+std::string syntheticObj(const std::size_t bytes);
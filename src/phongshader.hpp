@@ -0,0 +1,163 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "geometry.hpp"
+#include "gl.hpp"
+#include "model.hpp"
+
+extern mat<4, 4> ModelView, Perspective;
+
+// Normal-mapped Phong lighting of a Model; the renderer draws every model
+// with it, and the benchmarks render the same scenes.
+struct PhongShader final : IShader
+{
+    struct alignas(kCacheLineSize) Uniforms
+    {
+        mat<4, 4> normalMatrix;
+        vec4 l;
+    };
+
+    const Model& model;
+    vec3 light;
+    Texture::Filter filter;
+    Uniforms uniforms;
+    LookupTable<1024> specular{[](const real x)
+                               { return std::pow(x, real(35)); }};
+    std::vector<vec2> varyingUV;
+
+    PhongShader(const vec3 light, const Model& m,
+                const Texture::Filter filter = Texture::Filter::Nearest)
+        : model(m), light(light), filter(filter), varyingUV(m.nvertices())
+    {
+        bindUniforms();
+    }
+
+    // Refreshes the uniform block from the current transforms; called once
+    // per draw before the vertex stage.
+    void bindUniforms()
+    {
+        uniforms.normalMatrix = ModelView.invertTranspose();
+        uniforms.l =
+            normalized(ModelView * vec4{light.x, light.y, light.z, 0.0});
+    }
+
+    virtual vec4 vertex(const int vert)
+    {
+        const Vertex& v{model.vertex(vert)};
+        varyingUV[vert] = v.uv;
+        vec4 glPosition{ModelView * v.position};
+        return Perspective * glPosition;
+    }
+
+    virtual std::pair<bool, TGAColor> fragment(const int face,
+                                               const vec3 bar) const
+    {
+        TGAColor glFragColor{{255, 255, 255, 255}};
+        const vec4 l{uniforms.l};
+
+        vec2 uv{varyingUV[model.index(face, 0)] * bar[0] +
+                varyingUV[model.index(face, 1)] * bar[1] +
+                varyingUV[model.index(face, 2)] * bar[2]};
+        // A single fragment has no screen-space derivatives, so trilinear
+        // filtering samples the base level here.
+        const vec4 nm{filter == Texture::Filter::Nearest
+                          ? model.normal(uv)
+                          : model.normal(uv, 0, filter)};
+        vec4 n{normalized(uniforms.normalMatrix * nm)};
+        vec4 r{normalized(2 * n * (n * l) - l)};
+
+        real ambient{0.3};
+        real diff{std::max<real>(0, n * l)};
+        real spec{specular(r.z)};
+
+        for (int channel : {0, 1, 2})
+            glFragColor[channel] *=
+                std::min<real>(1, ambient + 0.4 * diff + 0.9 * spec);
+
+        return {false, glFragColor};
+    }
+
+    // Same lighting as fragment() for a packet of up to eight fragments. The
+    // normal map is fetched per lane, with the mip level for trilinear
+    // filtering chosen from the packet's uv derivatives; everything after it
+    // runs on SoA arrays so the compiler can vectorize each step across lanes.
+    unsigned fragments(const FragmentPacket& packet, TGAColor colors[]) const
+    {
+        constexpr int N{FragmentPacket::size};
+        const mat<4, 4>& m{uniforms.normalMatrix};
+        const vec4 l{uniforms.l};
+        const vec2 uv0{varyingUV[model.index(packet.face, 0)]};
+        const vec2 uv1{varyingUV[model.index(packet.face, 1)]};
+        const vec2 uv2{varyingUV[model.index(packet.face, 2)]};
+        const real lod{
+            filter == Texture::Filter::Trilinear
+                ? model.normalLod(ddx(packet, uv0, uv1, uv2),
+                                  ddy(packet, uv0, uv1, uv2))
+                : 0};
+        alignas(32) real n[4][N];
+        alignas(32) real rz[N];
+        alignas(32) real diffuse[N];
+
+        for (int k{0}; k < N; ++k)
+        {
+            const vec2 uv{uv0 * packet.bc[0][k] + uv1 * packet.bc[1][k] +
+                          uv2 * packet.bc[2][k]};
+            const vec4 normal{filter == Texture::Filter::Nearest
+                                  ? model.normal(uv)
+                                  : model.normal(uv, lod, filter)};
+
+            for (int i{4}; i--;) n[i][k] = normal[i];
+        }
+
+        for (int k{0}; k < N; ++k)
+        {
+            real t[4];
+
+            for (int i{4}; i--;)
+            {
+                t[i] = 0;
+
+                for (int j{4}; j--;) t[i] += m[i][j] * n[j][k];
+            }
+
+            real len{0};
+
+            for (int i{4}; i--;) len += t[i] * t[i];
+
+            len = std::sqrt(len);
+            len = len == 0 ? 1 : len;
+
+            for (int i{4}; i--;) t[i] /= len;
+
+            real nl{0};
+
+            for (int i{4}; i--;) nl += t[i] * l[i];
+
+            real r[4];
+            real rlen{0};
+
+            for (int i{4}; i--;) r[i] = t[i] * 2 * nl - l[i];
+            for (int i{4}; i--;) rlen += r[i] * r[i];
+
+            rlen = std::sqrt(rlen);
+            rz[k] = rlen == 0 ? r[2] : r[2] / rlen;
+            diffuse[k] = std::max<real>(0, nl);
+        }
+
+        for (int k{0}; k < N; ++k)
+        {
+            const real ambient{0.3};
+            const real spec{specular(rz[k])};
+            const real light{std::min<real>(
+                1, ambient + 0.4 * diffuse[k] + 0.9 * spec)};
+            const std::uint8_t c(255 * light);
+
+            colors[k] = {{c, c, c, 255}};
+        }
+
+        return packet.mask;
+    }
+};
@@ -0,0 +1,234 @@
+#include "profile.hpp"
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <mutex>
+
+namespace profile
+{
+
+#ifdef RASTERIZER_PROFILE
+
+namespace
+{
+
+constexpr const char* timerNames[]{
+    "obj load",     "mesh cache load", "texture load", "tga decode",
+    "vertex stage", "triangle setup",  "rasterization", "shading",
+    "resolve",      "frame",           "tga encode",   "image write"};
+
+constexpr const char* counterNames[]{
+    "triangles in",     "triangles culled", "pixels tested",
+    "depth test fails", "fragments shaded", "pixels written",
+    "pixels covered"};
+
+static_assert(std::size(timerNames) == kTimers);
+static_assert(std::size(counterNames) == kCounters);
+
+bool open(std::ofstream& out, const std::filesystem::path& filename)
+{
+    out.open(filename);
+
+    if (!out)
+        std::cerr << "Cannot open file " << filename << std::endl;
+
+    return static_cast<bool>(out);
+}
+
+bool close(std::ofstream& out, const std::filesystem::path& filename)
+{
+    out.close();
+
+    if (!out)
+        std::cerr << "Error writing " << filename << std::endl;
+
+    return static_cast<bool>(out);
+}
+
+// Live threads, and what the threads that have exited left behind.
+struct Registry
+{
+    std::mutex mutex{};
+    std::vector<ThreadProfile*> live{};
+    int threads{0};
+    TimerTotals timers[kTimers]{};
+    long long counters[kCounters]{};
+    std::vector<std::pair<int, Event>> events{};
+};
+
+Registry& registry()
+{
+    static Registry r;
+    return r;
+}
+
+// Trace timestamps count from the start of the program.
+const std::int64_t origin{now()};
+
+void merge(TimerTotals (&timers)[kTimers], long long (&counters)[kCounters],
+           const ThreadProfile& data)
+{
+    for (int i{0}; i < kTimers; ++i)
+    {
+        timers[i].calls += data.timers[i].calls;
+        timers[i].total += data.timers[i].total;
+        timers[i].max = std::max(timers[i].max, data.timers[i].max);
+    }
+
+    for (int i{0}; i < kCounters; ++i) counters[i] += data.counters[i];
+}
+
+// Totals over the exited and the live threads.
+void totals(TimerTotals (&timers)[kTimers], long long (&counters)[kCounters])
+{
+    Registry& r{registry()};
+    std::lock_guard lock(r.mutex);
+
+    std::copy(std::begin(r.timers), std::end(r.timers), timers);
+    std::copy(std::begin(r.counters), std::end(r.counters), counters);
+
+    for (const ThreadProfile* data : r.live) merge(timers, counters, *data);
+}
+
+double ms(const std::int64_t ns)
+{
+    return ns * 1e-6;
+}
+
+}  // namespace
+
+std::int64_t now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+ThreadProfile::ThreadProfile()
+{
+    Registry& r{registry()};
+    std::lock_guard lock(r.mutex);
+
+    id = r.threads++;
+    r.live.push_back(this);
+}
+
+ThreadProfile::~ThreadProfile()
+{
+    Registry& r{registry()};
+    std::lock_guard lock(r.mutex);
+
+    merge(r.timers, r.counters, *this);
+
+    for (const Event& e : events) r.events.emplace_back(id, e);
+
+    std::erase(r.live, this);
+}
+
+bool writeSummary(const std::filesystem::path& filename)
+{
+    TimerTotals timers[kTimers];
+    long long counters[kCounters];
+    std::ofstream out;
+
+    totals(timers, counters);
+
+    if (!open(out, filename))
+        return false;
+
+    out << std::fixed << std::setprecision(3) << "{\n  \"timers\": {";
+
+    for (int i{0}; i < kTimers; ++i)
+        out << (i ? ",\n" : "\n") << "    \"" << timerNames[i]
+            << "\": {\"calls\": " << timers[i].calls
+            << ", \"total_ms\": " << ms(timers[i].total)
+            << ", \"max_ms\": " << ms(timers[i].max) << '}';
+
+    out << "\n  },\n  \"counters\": {";
+
+    for (int i{0}; i < kCounters; ++i)
+        out << (i ? ",\n" : "\n") << "    \"" << counterNames[i]
+            << "\": " << counters[i];
+
+    const long long covered{
+        counters[static_cast<int>(Counter::PixelsCovered)]};
+    const long long written{
+        counters[static_cast<int>(Counter::PixelsWritten)]};
+
+    out << "\n  },\n  \"overdraw\": "
+        << (covered ? double(written) / covered : 0) << "\n}\n";
+
+    return close(out, filename);
+}
+
+bool writeTrace(const std::filesystem::path& filename)
+{
+    TimerTotals timers[kTimers];
+    long long counters[kCounters];
+    std::vector<std::pair<int, Event>> events;
+    std::ofstream out;
+
+    totals(timers, counters);
+
+    {
+        Registry& r{registry()};
+        std::lock_guard lock(r.mutex);
+
+        events = r.events;
+
+        for (const ThreadProfile* data : r.live)
+            for (const Event& e : data->events)
+                events.emplace_back(data->id, e);
+    }
+
+    if (!open(out, filename))
+        return false;
+
+    std::int64_t end{0};
+    out << std::fixed << std::setprecision(3) << "{\"traceEvents\": [";
+
+    for (std::size_t i{0}; i < events.size(); ++i)
+    {
+        const auto& [tid, e]{events[i]};
+        end = std::max(end, e.start + e.duration);
+        out << (i ? ",\n" : "\n") << "{\"name\": \""
+            << timerNames[static_cast<int>(e.timer)]
+            << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << tid
+            << ", \"ts\": " << (e.start - origin) * 1e-3
+            << ", \"dur\": " << e.duration * 1e-3 << '}';
+    }
+
+    out << (events.empty() ? "\n" : ",\n")
+        << "{\"name\": \"counters\", \"ph\": \"C\", \"pid\": 1, \"tid\": 0"
+        << ", \"ts\": " << (std::max(end, origin) - origin) * 1e-3
+        << ", \"args\": {";
+
+    for (int i{0}; i < kCounters; ++i)
+        out << (i ? ", " : "") << '"' << counterNames[i]
+            << "\": " << counters[i];
+
+    out << "}}\n], \"displayTimeUnit\": \"ms\"}\n";
+
+    return close(out, filename);
+}
+
+#else
+
+bool writeSummary(const std::filesystem::path&)
+{
+    std::cerr << "Built without RASTERIZER_PROFILE" << std::endl;
+    return false;
+}
+
+bool writeTrace(const std::filesystem::path&)
+{
+    std::cerr << "Built without RASTERIZER_PROFILE" << std::endl;
+    return false;
+}
+
+#endif
+
+}  // namespace profile
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+// Built-in instrumentation, compiled in with -DRASTERIZER_PROFILE=ON and
+// free otherwise: the macros expand to nothing and their arguments are not
+// evaluated.
+//
+// PROFILE_SCOPE(Timer) times the enclosing scope and records it as a trace
+// event; PROFILE_SUM(Timer) only adds to the timer's totals, for scopes run
+// per triangle or per pixel. PROFILE_COUNT(Counter, n) adds n to a counter.
+// Every thread keeps its own totals and events, so the hooks take no lock;
+// the reports merge them and must run while no other thread records.
+namespace profile
+{
+
+#ifdef RASTERIZER_PROFILE
+constexpr bool enabled{true};
+#else
+constexpr bool enabled{false};
+#endif
+
+enum class Timer
+{
+    ObjLoad,
+    MeshCacheLoad,
+    TextureLoad,
+    TgaDecode,
+    VertexStage,
+    TriangleSetup,
+    Rasterization,
+    Shading,
+    Resolve,
+    Frame,
+    TgaEncode,
+    ImageWrite,
+    count
+};
+
+enum class Counter
+{
+    TrianglesIn,
+    TrianglesCulled,
+    PixelsTested,
+    DepthFails,
+    FragmentsShaded,
+    PixelsWritten,
+    PixelsCovered,
+    count
+};
+
+// Timer and counter totals of all threads as one JSON object, with the
+// overdraw (pixels written per covered pixel) derived from the counters.
+bool writeSummary(const std::filesystem::path& filename);
+
+// The traced scopes as complete events in the Chrome trace event format
+// (chrome://tracing, Perfetto), followed by the counters.
+bool writeTrace(const std::filesystem::path& filename);
+
+#ifdef RASTERIZER_PROFILE
+
+constexpr int kTimers{static_cast<int>(Timer::count)};
+constexpr int kCounters{static_cast<int>(Counter::count)};
+
+std::int64_t now();
+
+struct TimerTotals
+{
+    long long calls{0};
+    std::int64_t total{0};
+    std::int64_t max{0};
+};
+
+struct Event
+{
+    Timer timer;
+    std::int64_t start;
+    std::int64_t duration;
+};
+
+// Registers itself on the first hook a thread runs and hands its data over
+// to the reports when the thread exits.
+struct ThreadProfile
+{
+    int id;
+    TimerTotals timers[kTimers]{};
+    long long counters[kCounters]{};
+    std::vector<Event> events{};
+
+    ThreadProfile();
+    ~ThreadProfile();
+};
+
+inline ThreadProfile& local()
+{
+    thread_local ThreadProfile data;
+    return data;
+}
+
+inline void count(const Counter counter, const long long n)
+{
+    local().counters[static_cast<int>(counter)] += n;
+}
+
+class Scope
+{
+   public:
+    Scope(const Timer timer, const bool traced)
+        : timer(timer), traced(traced), start(now())
+    {
+    }
+
+    ~Scope()
+    {
+        const std::int64_t duration{now() - start};
+        ThreadProfile& data{local()};
+        TimerTotals& totals{data.timers[static_cast<int>(timer)]};
+
+        ++totals.calls;
+        totals.total += duration;
+        totals.max = std::max(totals.max, duration);
+
+        if (traced)
+            data.events.push_back({timer, start, duration});
+    }
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+   private:
+    Timer timer;
+    bool traced;
+    std::int64_t start;
+};
+
+#define PROFILE_JOIN2(a, b) a##b
+#define PROFILE_JOIN(a, b) PROFILE_JOIN2(a, b)
+#define PROFILE_SCOPE(timer)                                    \
+    const profile::Scope PROFILE_JOIN(profileScope, __LINE__) { \
+        profile::Timer::timer, true                             \
+    }
+#define PROFILE_SUM(timer)                                      \
+    const profile::Scope PROFILE_JOIN(profileScope, __LINE__) { \
+        profile::Timer::timer, false                            \
+    }
+#define PROFILE_COUNT(counter, n) \
+    profile::count(profile::Counter::counter, (n))
+
+#else
+
+#define PROFILE_SCOPE(timer) static_cast<void>(0)
+#define PROFILE_SUM(timer) static_cast<void>(0)
+#define PROFILE_COUNT(counter, n) static_cast<void>(0)
+
+#endif
+
+}  // namespace profile
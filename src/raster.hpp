@@ -0,0 +1,386 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <concepts>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "gl.hpp"
+#include "profile.hpp"
+
+// The rasterizer core is templated on the shader type. Shaders declared
+// final are called directly and can be inlined into the pixel loops; the
+// IShader instantiation in gl.cpp is the virtual fallback for shaders only
+// known at run time.
+template <typename Shader>
+concept FragmentShader =
+    requires(const Shader& shader, const int face, const vec3 bar) {
+        {
+            shader.fragment(face, bar)
+        } -> std::same_as<std::pair<bool, TGAColor>>;
+    };
+
+// Shaders that can also shade a whole FragmentPacket at once. fragments()
+// fills colors[k] for the live lanes it keeps and returns their mask; lanes
+// left out of the mask are discarded. The block rasterizer prefers this
+// entry point; span walking and the visibility resolve still call fragment().
+template <typename Shader>
+concept PacketShader =
+    FragmentShader<Shader> &&
+    requires(const Shader& shader, const FragmentPacket& packet,
+             TGAColor* colors) {
+        {
+            shader.fragments(packet, colors)
+        } -> std::same_as<unsigned>;
+    };
+
+extern bool depthOnly;
+extern std::uint32_t* visibilityIds;
+extern std::uint32_t visibilityBase;
+extern RowTest blockRowTest;
+
+namespace detail
+{
+
+// Profiling counters for the block row of 8 pixels from (x, y): the lanes
+// covered by the triangle reach the depth test, and those not in passed
+// lost it. Coverage is computed as the portable row test does.
+inline void countDepthTests(const TriangleSetup& setup, const int x,
+                            const int y, const unsigned lanes,
+                            const unsigned passed)
+{
+    const dvec3 start{setup.bc0 + setup.bcdy * y + setup.bcdx * x};
+    unsigned covered{0};
+
+    for (int k{0}; k < 8; ++k)
+    {
+        bool inside{true};
+
+        for (int i{0}; i < 3; ++i)
+            inside &= start[i] + k * setup.bcdx[i] >= setup.bias[i];
+
+        covered |= unsigned(inside) << k;
+    }
+
+    covered &= lanes;
+    PROFILE_COUNT(PixelsTested, std::popcount(covered));
+    PROFILE_COUNT(DepthFails, std::popcount(covered & ~passed));
+}
+
+// Walks pixels x0..x1 of row y, stepping barycentrics and depth by one
+// addition per pixel. depth points at the z-buffer entry of (x0, y).
+template <FragmentShader Shader>
+void rasterizeSpan(const TriangleSetup& setup, const int y, const int x0,
+                   const int x1, const Shader& shader,
+                   Framebuffer& framebuffer, double* depth)
+{
+    dvec3 bc{setup.bc0 + setup.bcdy * y + setup.bcdx * x0};
+    double z{setup.z0 + setup.zdy * y + setup.zdx * x0};
+
+    for (int x{x0}; x <= x1;
+         ++x, ++depth, bc = bc + setup.bcdx, z += setup.zdx)
+    {
+        if (bc.x < setup.bias.x || bc.y < setup.bias.y || bc.z < setup.bias.z)
+            continue;
+
+        PROFILE_COUNT(PixelsTested, 1);
+
+        if (z <= *depth)
+        {
+            PROFILE_COUNT(DepthFails, 1);
+            continue;
+        }
+
+        if (visibilityIds)
+            visibilityIds[x + y * framebuffer.width()] =
+                visibilityBase + setup.face;
+        else if (!depthOnly)
+        {
+            PROFILE_SUM(Shading);
+            PROFILE_COUNT(FragmentsShaded, 1);
+            auto [discard, color]{shader.fragment(
+                setup.face, static_cast<vec3>(shadingBarycentrics(setup, bc)))};
+
+            if (discard)
+                continue;
+
+            framebuffer.set(x, y, color);
+        }
+
+        PROFILE_COUNT(PixelsWritten, 1);
+        *depth = z;
+    }
+}
+
+// Shades the live lanes of one block row as a packet and writes the lanes
+// the shader keeps. Returns whether any pixel was written.
+template <PacketShader Shader>
+bool shadePacket(const TriangleSetup& setup, const int x, const int y,
+                 const unsigned mask, const BlockRow& row,
+                 const Shader& shader, Framebuffer& framebuffer,
+                 double* zrow)
+{
+    PROFILE_SUM(Shading);
+    PROFILE_COUNT(FragmentsShaded, std::popcount(mask));
+    FragmentPacket packet;
+    TGAColor colors[FragmentPacket::size];
+
+    packet.face = setup.face;
+    packet.x = x;
+    packet.y = y;
+    packet.mask = mask;
+    packet.bcdx = static_cast<vec3>(shadingBarycentrics(setup, setup.bcdx));
+    packet.bcdy = static_cast<vec3>(shadingBarycentrics(setup, setup.bcdy));
+
+    if (setup.clipped)
+    {
+        for (int k{FragmentPacket::size}; k--;)
+        {
+            const dvec3 bc{shadingBarycentrics(
+                setup, {row.bc[0][k], row.bc[1][k], row.bc[2][k]})};
+
+            for (int i{3}; i--;) packet.bc[i][k] = static_cast<real>(bc[i]);
+        }
+    }
+    else
+    {
+        for (int i{3}; i--;)
+            for (int k{FragmentPacket::size}; k--;)
+                packet.bc[i][k] =
+                    static_cast<real>(row.bc[i][k] * setup.scale);
+    }
+
+    const unsigned kept{shader.fragments(packet, colors) & mask};
+    PROFILE_COUNT(PixelsWritten, std::popcount(kept));
+
+    for (unsigned m{kept}; m; m &= m - 1)
+    {
+        const int k{std::countr_zero(m)};
+        zrow[k] = row.z[k];
+        framebuffer.set(x + k, y, colors[k]);
+    }
+
+    return kept != 0;
+}
+
+// Rasterizes the pixels [xmin, xmax] x [ymin, ymax] of the 8x8 block at
+// (bx, by), whose in-bounds extent is [bx, bxmax] x [by, bymax]. The block is
+// skipped when one edge function is negative at all four corners, or when
+// the nearest corner depth cannot beat the block's minimum depth. Both
+// quantities are affine, so their extremes over the block lie at a corner.
+template <FragmentShader Shader>
+void rasterizeBlock(const TriangleSetup& setup, const int bx, const int by,
+                    const int bxmax, const int bymax, const int xmin,
+                    const int xmax, const int ymin, const int ymax,
+                    const Shader& shader, Framebuffer& framebuffer,
+                    const DepthView& depth)
+{
+    constexpr double eps{1e-9};
+    const int cx[4]{xmin, xmax, xmin, xmax};
+    const int cy[4]{ymin, ymin, ymax, ymax};
+    dvec3 corner[4];
+    double zmax{-std::numeric_limits<double>::infinity()};
+
+    for (int c{4}; c--;)
+    {
+        corner[c] = setup.bc0 + setup.bcdy * cy[c] + setup.bcdx * cx[c];
+        zmax = std::max(zmax, setup.z0 + setup.zdy * cy[c] + setup.zdx * cx[c]);
+    }
+
+    for (int i{3}; i--;)
+        if (corner[0][i] < -eps && corner[1][i] < -eps &&
+            corner[2][i] < -eps && corner[3][i] < -eps)
+            return;
+
+    double& blockMin{depth.blockMin(bx, by)};
+
+    if (zmax + eps <= blockMin)
+        return;
+
+    const unsigned lanes{(0xffu >> (7 - (xmax - bx))) & (0xffu << (xmin - bx))};
+    BlockRow row;
+    bool written{false};
+
+    for (int y{ymin}; y <= ymax; ++y)
+    {
+        double* zrow{&depth.at(bx, y)};
+        unsigned mask{blockRowTest(setup, bx, y, zrow, row) & lanes};
+
+        if constexpr (profile::enabled)
+            countDepthTests(setup, bx, y, lanes, mask);
+
+        if constexpr (PacketShader<Shader>)
+        {
+            if (mask && !visibilityIds && !depthOnly)
+            {
+                written |= shadePacket(setup, bx, y, mask, row, shader,
+                                       framebuffer, zrow);
+                continue;
+            }
+        }
+
+        for (; mask; mask &= mask - 1)
+        {
+            const int k{std::countr_zero(mask)};
+
+            if (visibilityIds)
+                visibilityIds[bx + k + y * framebuffer.width()] =
+                    visibilityBase + setup.face;
+            else if (!depthOnly)
+            {
+                PROFILE_SUM(Shading);
+                PROFILE_COUNT(FragmentsShaded, 1);
+                const vec3 bc{static_cast<vec3>(shadingBarycentrics(
+                    setup, {row.bc[0][k], row.bc[1][k], row.bc[2][k]}))};
+                auto [discard, color]{shader.fragment(setup.face, bc)};
+
+                if (discard)
+                    continue;
+
+                framebuffer.set(bx + k, y, color);
+            }
+
+            PROFILE_COUNT(PixelsWritten, 1);
+            zrow[k] = row.z[k];
+            written = true;
+        }
+    }
+
+    if (!written)
+        return;
+
+    double m{std::numeric_limits<double>::infinity()};
+
+    for (int y{by}; y <= bymax; ++y)
+        for (int x{bx}; x <= bxmax; ++x) m = std::min(m, depth.at(x, y));
+
+    blockMin = m;
+}
+
+// Rasterizes one row of 8x8 blocks starting at by, clipped to the rect.
+template <FragmentShader Shader>
+void rasterizeBlockRow(const TriangleSetup& setup, const int by,
+                       const int x0, const int y0, const int x1, const int y1,
+                       const Shader& shader, Framebuffer& framebuffer,
+                       const DepthView& depth)
+{
+    constexpr int B{DepthView::blockSize};
+    const int xmin{std::max(x0, setup.bbminx)};
+    const int xmax{std::min(x1, setup.bbmaxx)};
+    const int ymin{std::max({y0, by, setup.bbminy})};
+    const int ymax{std::min({y1, by + B - 1, setup.bbmaxy})};
+    const int bymax{std::min(y1, by + B - 1)};
+
+    for (int bx{xmin & ~(B - 1)}; bx <= xmax; bx += B)
+        rasterizeBlock(setup, bx, by, std::min(x1, bx + B - 1), bymax,
+                       std::max(xmin, bx), std::min(xmax, bx + B - 1), ymin,
+                       ymax, shader, framebuffer, depth);
+}
+
+// Recomputes from the z-buffer the minimum depth of the blocks in the row
+// starting at by that touch columns xmin..xmax, with blocks clipped at
+// (x1, y1). The span walker writes depth pixel by pixel and calls this after
+// each triangle, so that the block minima, and the HiZ pyramid built from
+// them, see its writes as they see the block rasterizer's.
+inline void refreshBlockMinima(const DepthView& depth, const int by,
+                               const int xmin, const int xmax, const int x1,
+                               const int y1)
+{
+    constexpr int B{DepthView::blockSize};
+    const int bymax{std::min(y1, by + B - 1)};
+
+    for (int bx{xmin & ~(B - 1)}; bx <= xmax; bx += B)
+    {
+        const int bxmax{std::min(x1, bx + B - 1)};
+        double m{std::numeric_limits<double>::infinity()};
+
+        for (int y{by}; y <= bymax; ++y)
+            for (int x{bx}; x <= bxmax; ++x) m = std::min(m, depth.at(x, y));
+
+        depth.blockMin(bx, by) = m;
+    }
+}
+
+}  // namespace detail
+
+// Rasterizes the part of the triangle inside [x0, x1] x [y0, y1].
+template <FragmentShader Shader>
+void rasterizeRect(const TriangleSetup& setup, const int x0, const int y0,
+                   const int x1, const int y1, const Shader& shader,
+                   Framebuffer& framebuffer, const DepthView& depth)
+{
+    PROFILE_SUM(Rasterization);
+    const int ymin{std::max(y0, setup.bbminy)};
+    const int ymax{std::min(y1, setup.bbmaxy)};
+
+    if (blockRowTest)
+    {
+        constexpr int B{DepthView::blockSize};
+
+        for (int by{ymin & ~(B - 1)}; by <= ymax; by += B)
+            detail::rasterizeBlockRow(setup, by, x0, y0, x1, y1, shader,
+                                      framebuffer, depth);
+        return;
+    }
+
+    const int xmin{std::max(x0, setup.bbminx)};
+    const int xmax{std::min(x1, setup.bbmaxx)};
+
+    for (int y{ymin}; y <= ymax; ++y)
+        detail::rasterizeSpan(setup, y, xmin, xmax, shader, framebuffer,
+                              &depth.at(xmin, y));
+
+    constexpr int B{DepthView::blockSize};
+
+    for (int by{ymin & ~(B - 1)}; by <= ymax; by += B)
+        detail::refreshBlockMinima(depth, by, xmin, xmax, x1, y1);
+}
+
+// Rasterizes a triangle set up by primitive assembly over the framebuffer,
+// splitting its rows among nthreads threads.
+template <FragmentShader Shader>
+void rasterize(const TriangleSetup& setup, const Shader& shader,
+               Framebuffer& framebuffer, const int nthreads)
+{
+    PROFILE_SUM(Rasterization);
+    constexpr int B{DepthView::blockSize};
+    const int width{framebuffer.width()};
+    const int height{framebuffer.height()};
+    const DepthView depth{framebuffer.depth(), framebuffer.depthMin(), 0, 0,
+                          width, framebuffer.blockStride()};
+
+    if (triangleOccluded(setup))
+        return;
+
+    if (blockRowTest)
+    {
+#pragma omp parallel for num_threads(nthreads)
+
+        for (int by = setup.bbminy & ~(B - 1); by <= setup.bbmaxy; by += B)
+            detail::rasterizeBlockRow(setup, by, 0, 0, width - 1, height - 1,
+                                      shader, framebuffer, depth);
+        return;
+    }
+
+#pragma omp parallel for num_threads(nthreads)
+
+    for (int y = setup.bbminy; y <= setup.bbmaxy; ++y)
+        detail::rasterizeSpan(setup, y, setup.bbminx, setup.bbmaxx, shader,
+                              framebuffer, &depth.at(setup.bbminx, y));
+
+#pragma omp parallel for num_threads(nthreads)
+
+    for (int by = setup.bbminy & ~(B - 1); by <= setup.bbmaxy; by += B)
+        detail::refreshBlockMinima(depth, by, setup.bbminx, setup.bbmaxx,
+                                   width - 1, height - 1);
+}
+
+extern template void rasterizeRect<IShader>(const TriangleSetup&, const int,
+                                            const int, const int, const int,
+                                            const IShader&, Framebuffer&,
+                                            const DepthView&);
+extern template void rasterize<IShader>(const TriangleSetup&, const IShader&,
+                                        Framebuffer&, const int);
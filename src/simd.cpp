@@ -0,0 +1,350 @@
+#include "simd.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include "gl.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define RASTERIZER_X86
+#include <immintrin.h>
+#endif
+
+Isa detectIsa()
+{
+#ifdef RASTERIZER_X86
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2"))
+        return Isa::AVX2;
+
+    if (__builtin_cpu_supports("sse4.1"))
+        return Isa::SSE41;
+#endif
+
+    return Isa::Portable;
+}
+
+bool isaSupported(const Isa isa)
+{
+    return isa <= detectIsa();
+}
+
+const char* isaName(const Isa isa)
+{
+    switch (isa)
+    {
+        case Isa::Scalar:
+            return "scalar";
+        case Isa::Portable:
+            return "portable";
+        case Isa::SSE41:
+            return "sse4.1";
+        case Isa::AVX2:
+            return "avx2";
+    }
+
+    return "?";
+}
+
+bool parseIsa(const std::string_view name, Isa& isa)
+{
+    for (Isa i : {Isa::Scalar, Isa::Portable, Isa::SSE41, Isa::AVX2})
+    {
+        if (name == isaName(i))
+        {
+            isa = i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Every kernel computes lane k as start + k * step with the row start taken
+// from the same expression, so all ISAs produce bit-identical barycentrics.
+static unsigned rowTestPortable(const TriangleSetup& setup, const int x,
+                                const int y, const double* depth,
+                                BlockRow& row)
+{
+    const dvec3 start{setup.bc0 + setup.bcdy * y + setup.bcdx * x};
+    const double z{setup.z0 + setup.zdy * y + setup.zdx * x};
+    unsigned mask{0};
+
+    for (int k{0}; k < 8; ++k)
+    {
+        bool covered{true};
+
+        for (int i{0}; i < 3; ++i)
+        {
+            row.bc[i][k] = start[i] + k * setup.bcdx[i];
+            covered &= row.bc[i][k] >= setup.bias[i];
+        }
+
+        row.z[k] = z + k * setup.zdx;
+        mask |= unsigned(covered && row.z[k] > depth[k]) << k;
+    }
+
+    return mask;
+}
+
+#ifdef RASTERIZER_X86
+
+__attribute__((target("sse4.1"))) static unsigned rowTestSSE41(
+    const TriangleSetup& setup, const int x, const int y, const double* depth,
+    BlockRow& row)
+{
+    const dvec3 start{setup.bc0 + setup.bcdy * y + setup.bcdx * x};
+    const double z{setup.z0 + setup.zdy * y + setup.zdx * x};
+    const __m128d lanes[4]{_mm_setr_pd(0, 1), _mm_setr_pd(2, 3),
+                           _mm_setr_pd(4, 5), _mm_setr_pd(6, 7)};
+    unsigned mask{0xff};
+
+    for (int i{0}; i < 3 && mask; ++i)
+    {
+        const __m128d s{_mm_set1_pd(start[i])};
+        const __m128d d{_mm_set1_pd(setup.bcdx[i])};
+        const __m128d b{_mm_set1_pd(setup.bias[i])};
+        unsigned m{0};
+
+        for (int j{0}; j < 4; ++j)
+        {
+            const __m128d v{_mm_add_pd(s, _mm_mul_pd(lanes[j], d))};
+            _mm_store_pd(row.bc[i] + 2 * j, v);
+            m |= unsigned(_mm_movemask_pd(_mm_cmpge_pd(v, b))) << (2 * j);
+        }
+
+        mask &= m;
+    }
+
+    if (!mask)
+        return 0;
+
+    const __m128d s{_mm_set1_pd(z)};
+    const __m128d d{_mm_set1_pd(setup.zdx)};
+    unsigned m{0};
+
+    for (int j{0}; j < 4; ++j)
+    {
+        const __m128d v{_mm_add_pd(s, _mm_mul_pd(lanes[j], d))};
+        _mm_store_pd(row.z + 2 * j, v);
+        m |= unsigned(_mm_movemask_pd(
+                 _mm_cmpgt_pd(v, _mm_loadu_pd(depth + 2 * j))))
+             << (2 * j);
+    }
+
+    return mask & m;
+}
+
+__attribute__((target("avx2"))) static unsigned rowTestAVX2(
+    const TriangleSetup& setup, const int x, const int y, const double* depth,
+    BlockRow& row)
+{
+    const dvec3 start{setup.bc0 + setup.bcdy * y + setup.bcdx * x};
+    const double z{setup.z0 + setup.zdy * y + setup.zdx * x};
+    const __m256d lo{_mm256_setr_pd(0, 1, 2, 3)};
+    const __m256d hi{_mm256_setr_pd(4, 5, 6, 7)};
+    unsigned mask{0xff};
+
+    for (int i{0}; i < 3 && mask; ++i)
+    {
+        const __m256d s{_mm256_set1_pd(start[i])};
+        const __m256d d{_mm256_set1_pd(setup.bcdx[i])};
+        const __m256d b{_mm256_set1_pd(setup.bias[i])};
+        const __m256d v0{_mm256_add_pd(s, _mm256_mul_pd(lo, d))};
+        const __m256d v1{_mm256_add_pd(s, _mm256_mul_pd(hi, d))};
+
+        _mm256_store_pd(row.bc[i], v0);
+        _mm256_store_pd(row.bc[i] + 4, v1);
+        mask &= unsigned(_mm256_movemask_pd(_mm256_cmp_pd(v0, b, _CMP_GE_OQ))) |
+                unsigned(_mm256_movemask_pd(_mm256_cmp_pd(v1, b, _CMP_GE_OQ)))
+                    << 4;
+    }
+
+    if (!mask)
+        return 0;
+
+    const __m256d s{_mm256_set1_pd(z)};
+    const __m256d d{_mm256_set1_pd(setup.zdx)};
+    const __m256d v0{_mm256_add_pd(s, _mm256_mul_pd(lo, d))};
+    const __m256d v1{_mm256_add_pd(s, _mm256_mul_pd(hi, d))};
+
+    _mm256_store_pd(row.z, v0);
+    _mm256_store_pd(row.z + 4, v1);
+
+    return mask &
+           (unsigned(_mm256_movemask_pd(
+                _mm256_cmp_pd(v0, _mm256_loadu_pd(depth), _CMP_GT_OQ))) |
+            unsigned(_mm256_movemask_pd(
+                _mm256_cmp_pd(v1, _mm256_loadu_pd(depth + 4), _CMP_GT_OQ)))
+                << 4);
+}
+
+#endif
+
+RowTest rowTest(const Isa isa)
+{
+    switch (isa)
+    {
+        case Isa::Scalar:
+            return nullptr;
+#ifdef RASTERIZER_X86
+        case Isa::SSE41:
+            return rowTestSSE41;
+        case Isa::AVX2:
+            return rowTestAVX2;
+#endif
+        default:
+            return rowTestPortable;
+    }
+}
+
+// Equality bits for the count pixels from p, each against the next one.
+static std::uint64_t equalPixels(const std::uint8_t* p, const int bpp,
+                                 const std::size_t count)
+{
+    std::uint64_t bits{0};
+
+    for (std::size_t k{0}; k < count; ++k, p += bpp)
+        bits |= std::uint64_t(std::memcmp(p, p + bpp, bpp) == 0) << k;
+
+    return bits;
+}
+
+static std::uint64_t equalWordPortable(const std::uint8_t* p, const int bpp)
+{
+    return equalPixels(p, bpp, 64);
+}
+
+#ifdef RASTERIZER_X86
+
+static __m128i load128(const std::uint8_t* p)
+{
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+}
+
+__attribute__((target("avx2"))) static __m256i load256(const std::uint8_t* p)
+{
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+}
+
+// The 3-byte kernels widen 4 pixels to 32-bit lanes with a byte shuffle that
+// zeroes the top byte, so that they compare like 4-byte pixels. A word reads
+// up to 7 bytes past its 65th pixel.
+__attribute__((target("sse4.1"))) static std::uint64_t equalWordSSE41(
+    const std::uint8_t* p, const int bpp)
+{
+    std::uint64_t bits{0};
+
+    if (bpp == 4)
+    {
+        for (int k{0}; k < 64; k += 4, p += 16)
+            bits |= std::uint64_t(_mm_movemask_ps(_mm_castsi128_ps(
+                        _mm_cmpeq_epi32(load128(p), load128(p + 4)))))
+                    << k;
+    }
+    else if (bpp == 3)
+    {
+        const __m128i widen{_mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8,
+                                          -1, 9, 10, 11, -1)};
+
+        for (int k{0}; k < 64; k += 4, p += 12)
+            bits |= std::uint64_t(_mm_movemask_ps(_mm_castsi128_ps(
+                        _mm_cmpeq_epi32(
+                            _mm_shuffle_epi8(load128(p), widen),
+                            _mm_shuffle_epi8(load128(p + 3), widen)))))
+                    << k;
+    }
+    else
+    {
+        for (int k{0}; k < 64; k += 16, p += 16)
+            bits |= std::uint64_t(static_cast<std::uint16_t>(
+                        _mm_movemask_epi8(
+                            _mm_cmpeq_epi8(load128(p), load128(p + 1)))))
+                    << k;
+    }
+
+    return bits;
+}
+
+__attribute__((target("avx2"))) static __m256i loadPixels3(
+    const std::uint8_t* p)
+{
+    const __m256i widen{_mm256_setr_epi8(
+        0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1, 0, 1, 2, -1, 3,
+        4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1)};
+
+    return _mm256_shuffle_epi8(
+        _mm256_inserti128_si256(_mm256_castsi128_si256(load128(p)),
+                                load128(p + 12), 1),
+        widen);
+}
+
+__attribute__((target("avx2"))) static std::uint64_t equalWordAVX2(
+    const std::uint8_t* p, const int bpp)
+{
+    std::uint64_t bits{0};
+
+    if (bpp == 4)
+    {
+        for (int k{0}; k < 64; k += 8, p += 32)
+            bits |= std::uint64_t(_mm256_movemask_ps(_mm256_castsi256_ps(
+                        _mm256_cmpeq_epi32(load256(p), load256(p + 4)))))
+                    << k;
+    }
+    else if (bpp == 3)
+    {
+        for (int k{0}; k < 64; k += 8, p += 24)
+            bits |= std::uint64_t(_mm256_movemask_ps(_mm256_castsi256_ps(
+                        _mm256_cmpeq_epi32(loadPixels3(p),
+                                           loadPixels3(p + 3)))))
+                    << k;
+    }
+    else
+    {
+        for (int k{0}; k < 64; k += 32, p += 32)
+            bits |= std::uint64_t(static_cast<std::uint32_t>(
+                        _mm256_movemask_epi8(
+                            _mm256_cmpeq_epi8(load256(p), load256(p + 1)))))
+                    << k;
+    }
+
+    return bits;
+}
+
+#endif
+
+// Whole words go to the kernel while its reads stay inside the image; the
+// last word or two fall back to comparing pixel by pixel.
+template <std::uint64_t (*equalWord)(const std::uint8_t*, int)>
+static void scanPixelRuns(const std::uint8_t* pixels,
+                          const std::size_t npixels, const int bpp,
+                          const std::size_t first, const std::size_t last,
+                          std::uint64_t* mask)
+{
+    for (std::size_t i{first}; i < last; i += 64)
+    {
+        const std::uint8_t* const p{pixels + i * bpp};
+
+        if (i + 64 <= last && i + 67 <= npixels)
+            mask[i / 64] = equalWord(p, bpp);
+        else
+            mask[i / 64] =
+                equalPixels(p, bpp, std::min<std::size_t>(last - i, 64));
+    }
+}
+
+PixelRunScan pixelRunScan(const Isa isa)
+{
+    switch (isa)
+    {
+#ifdef RASTERIZER_X86
+        case Isa::SSE41:
+            return scanPixelRuns<equalWordSSE41>;
+        case Isa::AVX2:
+            return scanPixelRuns<equalWordAVX2>;
+#endif
+        default:
+            return scanPixelRuns<equalWordPortable>;
+    }
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+struct TriangleSetup;
+
+// Instruction sets the block rasterizer can run on. Scalar walks spans one
+// pixel at a time; the others test 8x8 blocks a row of 8 pixels at a time.
+enum class Isa
+{
+    Scalar,
+    Portable,
+    SSE41,
+    AVX2
+};
+
+Isa detectIsa();
+bool isaSupported(const Isa isa);
+const char* isaName(const Isa isa);
+bool parseIsa(const std::string_view name, Isa& isa);
+
+struct BlockRow
+{
+    alignas(32) double bc[3][8];
+    alignas(32) double z[8];
+};
+
+// Evaluates the 8 pixels (x..x+7, y) of a triangle. Returns the mask of lanes
+// that are covered and pass the depth test against depth[0..7], and fills row
+// with their barycentrics and depths.
+typedef unsigned (*RowTest)(const TriangleSetup& setup, const int x,
+                            const int y, const double* depth, BlockRow& row);
+
+RowTest rowTest(const Isa isa);
+
+// Sets bit i % 64 of mask[i / 64] when pixels i and i + 1 are equal, for i in
+// [first, last), in a packed image of npixels pixels of bpp (1, 3 or 4)
+// bytes. first must be a multiple of 64 and last below npixels; the words
+// covering the range are overwritten, with the bits from last on cleared.
+typedef void (*PixelRunScan)(const std::uint8_t* pixels,
+                             const std::size_t npixels, const int bpp,
+                             const std::size_t first, const std::size_t last,
+                             std::uint64_t* mask);
+
+PixelRunScan pixelRunScan(const Isa isa);
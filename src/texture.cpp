@@ -0,0 +1,100 @@
+#include "texture.hpp"
+
+#include <utility>
+
+Texture::Texture(const TGAImage& image)
+{
+    if (image.width() <= 0 || image.height() <= 0)
+        return;
+
+    std::size_t size{0};
+
+    for (int w{image.width()}, h{image.height()};; w = std::max(1, w / 2),
+             h = std::max(1, h / 2))
+    {
+        const int tilesX{(w + 3) / 4};
+        mips.push_back({w, h, tilesX, size});
+        size += static_cast<std::size_t>(tilesX) * ((h + 3) / 4) * 16;
+
+        if (w == 1 && h == 1)
+            break;
+    }
+
+    texels.resize(size);
+
+    const Level& base{mips[0]};
+
+    for (int y{0}; y < base.h; ++y)
+    {
+        for (int x{0}; x < base.w; ++x)
+        {
+            const TGAColor c{image.get(x, y)};
+            std::memcpy(&texels[address(base, x, y)], c.rgba.data(), 4);
+        }
+    }
+
+    // Each level is a 2x2 box filter of the one above; odd edges reuse the
+    // last row or column.
+    for (int level{1}; level < levels(); ++level)
+    {
+        const Level& src{mips[level - 1]};
+        const Level& dst{mips[level]};
+
+        for (int y{0}; y < dst.h; ++y)
+        {
+            for (int x{0}; x < dst.w; ++x)
+            {
+                const int x0{std::min(2 * x, src.w - 1)};
+                const int x1{std::min(2 * x + 1, src.w - 1)};
+                const int y0{std::min(2 * y, src.h - 1)};
+                const int y1{std::min(2 * y + 1, src.h - 1)};
+                const std::uint32_t t[4]{texels[address(src, x0, y0)],
+                                         texels[address(src, x1, y0)],
+                                         texels[address(src, x0, y1)],
+                                         texels[address(src, x1, y1)]};
+                std::uint32_t out{0};
+
+                for (int shift{0}; shift < 32; shift += 8)
+                {
+                    std::uint32_t sum{2};
+
+                    for (const std::uint32_t v : t) sum += v >> shift & 0xff;
+
+                    out |= (sum / 4) << shift;
+                }
+
+                texels[address(dst, x, y)] = out;
+            }
+        }
+    }
+}
+
+real Texture::lod(const vec2& duvdx, const vec2& duvdy) const
+{
+    const vec2 scale{static_cast<real>(mips[0].w),
+                     static_cast<real>(mips[0].h)};
+    const vec2 dx{duvdx[0] * scale[0], duvdx[1] * scale[1]};
+    const vec2 dy{duvdy[0] * scale[0], duvdy[1] * scale[1]};
+    const real rho{std::max(dx * dx, dy * dy)};
+
+    return rho > 1 ? std::log2(rho) / 2 : 0;
+}
+
+bool parseFilter(const std::string_view name, Texture::Filter& filter)
+{
+    constexpr std::pair<std::string_view, Texture::Filter> names[]{
+        {"nearest", Texture::Filter::Nearest},
+        {"bilinear", Texture::Filter::Bilinear},
+        {"trilinear", Texture::Filter::Trilinear}};
+
+    for (const auto& [n, f] : names)
+    {
+        if (name == n)
+        {
+            filter = f;
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+#include "geometry.hpp"
+#include "tgaimage.hpp"
+
+// Read-only texture built once from a TGAImage. Every level of the mip chain
+// is split into 4x4 texel tiles of 64 bytes, one cache line each, stored row
+// by row with the texels of a tile in Morton order, so a bilinear footprint
+// touches at most four lines and usually one. Texels keep the byte order of
+// TGAImage::get, padded to four bytes. Coordinates are clamped to the edge.
+class Texture
+{
+   public:
+    enum class Filter
+    {
+        Nearest,
+        Bilinear,
+        Trilinear
+    };
+
+    Texture() = default;
+    explicit Texture(const TGAImage& image);
+
+    bool empty() const noexcept { return mips.empty(); }
+    int width(const int level = 0) const noexcept { return mips[level].w; }
+    int height(const int level = 0) const noexcept { return mips[level].h; }
+    int levels() const noexcept { return static_cast<int>(mips.size()); }
+
+    // Unchecked fetch of texel (x, y) of a level.
+    TGAColor fetch(const int level, const int x, const int y) const
+    {
+        TGAColor c;
+        std::memcpy(c.rgba.data(), &texels[address(mips[level], x, y)], 4);
+        return c;
+    }
+
+    // Nearest texel of level 0, the texel TGAImage::get(u * w, v * h) reads.
+    TGAColor nearest(const vec2& uv) const
+    {
+        const Level& l{mips[0]};
+        return fetch(0, clamp(uv[0] * l.w, l.w), clamp(uv[1] * l.h, l.h));
+    }
+
+    // Bilinear blend of the four texels around uv on one level; channels
+    // are in [0, 255].
+    vec4 bilinear(const vec2& uv, const int level) const
+    {
+        return bilinear(uv, level, bytes);
+    }
+
+    // Blend of the bilinear samples of the two levels around lod.
+    vec4 trilinear(const vec2& uv, const real lod) const
+    {
+        return trilinear(uv, lod, bytes);
+    }
+
+    // Level of detail for a pixel whose uv changes by duvdx and duvdy per
+    // pixel step: log2 of the longer footprint axis in level 0 texels.
+    real lod(const vec2& duvdx, const vec2& duvdy) const;
+
+    // Samples with the given filter; lod only matters for Trilinear.
+    // Returns channels in [0, 255].
+    vec4 sample(const vec2& uv, const real lod, const Filter filter) const
+    {
+        return sample(uv, lod, filter, bytes);
+    }
+
+    // The same samplers for textures whose 32-bit texels hold some other
+    // encoding: decode turns one texel into the vec4 that gets filtered.
+    template <typename Decode>
+    vec4 nearest(const vec2& uv, Decode decode) const
+    {
+        const Level& l{mips[0]};
+        return decode(texels[address(l, clamp(uv[0] * l.w, l.w),
+                                     clamp(uv[1] * l.h, l.h))]);
+    }
+
+    template <typename Decode>
+    vec4 bilinear(const vec2& uv, const int level, Decode decode) const
+    {
+        const Level& l{mips[level]};
+        const real x{uv[0] * l.w - real(0.5)};
+        const real y{uv[1] * l.h - real(0.5)};
+        const real fx{std::floor(x)};
+        const real fy{std::floor(y)};
+        const real tx{x - fx};
+        const real ty{y - fy};
+        const int x0{std::clamp(static_cast<int>(fx), 0, l.w - 1)};
+        const int y0{std::clamp(static_cast<int>(fy), 0, l.h - 1)};
+        const int x1{std::clamp(static_cast<int>(fx) + 1, 0, l.w - 1)};
+        const int y1{std::clamp(static_cast<int>(fy) + 1, 0, l.h - 1)};
+
+        const vec4 top{decode(texels[address(l, x0, y0)]) * (1 - tx) +
+                       decode(texels[address(l, x1, y0)]) * tx};
+        const vec4 bottom{decode(texels[address(l, x0, y1)]) * (1 - tx) +
+                          decode(texels[address(l, x1, y1)]) * tx};
+        return top * (1 - ty) + bottom * ty;
+    }
+
+    template <typename Decode>
+    vec4 trilinear(const vec2& uv, const real lod, Decode decode) const
+    {
+        const real clamped{std::clamp<real>(lod, 0, levels() - 1)};
+        const int level{static_cast<int>(clamped)};
+        const real t{clamped - level};
+
+        if (t == 0 || level + 1 == levels())
+            return bilinear(uv, level, decode);
+
+        return bilinear(uv, level, decode) * (1 - t) +
+               bilinear(uv, level + 1, decode) * t;
+    }
+
+    template <typename Decode>
+    vec4 sample(const vec2& uv, const real lod, const Filter filter,
+                Decode decode) const
+    {
+        switch (filter)
+        {
+            case Filter::Nearest:
+                return nearest(uv, decode);
+            case Filter::Bilinear:
+                return bilinear(uv, 0, decode);
+            case Filter::Trilinear:
+                return trilinear(uv, lod, decode);
+        }
+
+        return {};
+    }
+
+    // Copy with the same layout whose texels are encode(texel) of this one.
+    template <typename Encode>
+    Texture transformed(Encode encode) const
+    {
+        Texture result{*this};
+
+        for (std::uint32_t& t : result.texels) t = encode(t);
+
+        return result;
+    }
+
+    // The four bytes of a texel in TGAImage::get order as a vec4.
+    static vec4 bytes(const std::uint32_t t)
+    {
+        return {static_cast<real>(t & 0xff), static_cast<real>(t >> 8 & 0xff),
+                static_cast<real>(t >> 16 & 0xff), static_cast<real>(t >> 24)};
+    }
+
+   private:
+    struct Level
+    {
+        int w, h;
+        int tilesX;
+        std::size_t offset;
+    };
+
+    std::vector<Level> mips{};
+    std::vector<std::uint32_t> texels{};
+
+    static int clamp(const real x, const int n)
+    {
+        return std::clamp(static_cast<int>(x), 0, n - 1);
+    }
+
+    static std::size_t address(const Level& l, const int x, const int y)
+    {
+        const int morton{(x & 1) | (y & 1) << 1 | (x & 2) << 1 | (y & 2) << 2};
+        return l.offset +
+               (static_cast<std::size_t>(y >> 2) * l.tilesX + (x >> 2)) * 16 +
+               morton;
+    }
+};
+
+bool parseFilter(const std::string_view name, Texture::Filter& filter);
@@ -1,7 +1,57 @@
 #include "tgaimage.hpp"
 
+#include <algorithm>
+#include <bit>
 #include <cstring>
 #include <iostream>
+#include <iterator>
+
+#include "mappedfile.hpp"
+#include "profile.hpp"
+#include "simd.hpp"
+
+// Copies count pixels between the in-memory RGB(A) order and the file's
+// BGR(A) order, which is the same swap either way.
+static void storePixels(const std::uint8_t* s, std::uint8_t* d,
+                        const std::size_t count, const std::size_t bpp)
+{
+    if (bpp == 1)
+    {
+        std::memcpy(d, s, count);
+    }
+    else if (bpp == 3)
+    {
+        for (std::size_t i{0}; i < count; ++i, s += 3, d += 3)
+        {
+            d[0] = s[2];
+            d[1] = s[1];
+            d[2] = s[0];
+        }
+    }
+    else
+    {
+        for (std::size_t i{0}; i < count; ++i, s += 4, d += 4)
+        {
+            d[0] = s[2];
+            d[1] = s[1];
+            d[2] = s[0];
+            d[3] = s[3];
+        }
+    }
+}
+
+// Fills count pixels with file pixel s, doubling the filled prefix with each
+// copy.
+static void fillPixels(const std::uint8_t* s, std::uint8_t* d,
+                       const std::size_t count, const std::size_t bpp)
+{
+    const std::size_t size{count * bpp};
+
+    storePixels(s, d, 1, bpp);
+
+    for (std::size_t done{bpp}; done < size; done *= 2)
+        std::memcpy(d + done, d, std::min(done, size - done));
+}
 
 TGAImage::TGAImage(const int w, const int h, const int bpp, TGAColor c) noexcept
     : w(w), h(h), bpp(bpp), data(w * h * bpp, 0)
@@ -59,35 +109,41 @@ void TGAImage::set(const int x, const int y, const TGAColor& c)
 
 bool TGAImage::readTGAFile(const std::filesystem::path& filename)
 {
-    std::ifstream in(filename, std::ios::binary);
+    const MappedFile file(filename);
 
-    if (!in)
+    if (!file)
     {
         std::cerr << "Cannot open file " << filename << '\n';
         return false;
     }
 
-    TGAHeader header{};
+    return decodeTGA({file.data(), file.size()});
+}
 
-    in.read(reinterpret_cast<char*>(&header), sizeof(header));
+bool TGAImage::decodeTGA(const std::span<const std::uint8_t> file)
+{
+    PROFILE_SCOPE(TgaDecode);
+    TGAHeader header{};
 
-    if (!in)
+    if (file.size() < sizeof(header))
     {
         std::cerr << "Error reading TGA header\n";
         return false;
     }
 
-    if (header.idLength)
-    {
-        in.seekg(header.idLength, std::ios::cur);
+    std::memcpy(&header, file.data(), sizeof(header));
 
-        if (!in)
-        {
-            std::cerr << "Error skipping TGA Image ID field\n";
-            return false;
-        }
+    const std::uint8_t* p{file.data() + sizeof(header)};
+    const std::uint8_t* const end{file.data() + file.size()};
+
+    if (header.idLength > end - p)
+    {
+        std::cerr << "Error skipping TGA Image ID field\n";
+        return false;
     }
 
+    p += header.idLength;
+
     if (header.colorMapType != 0)
     {
         std::cerr << "Color-mapped TGA not supported\n";
@@ -104,25 +160,24 @@ bool TGAImage::readTGAFile(const std::filesystem::path& filename)
         return false;
     }
 
-    const std::size_t nbytes = static_cast<std::size_t>(w) *
-                               static_cast<std::size_t>(h) *
-                               static_cast<std::size_t>(bpp);
-    data.assign(nbytes, 0);
+    const std::size_t rowBytes{static_cast<std::size_t>(w) * bpp};
+    const bool flip{!(header.imageDescriptor & 0x20)};
+    data.resize(rowBytes * static_cast<std::size_t>(h));
 
     if (header.dataTypeCode == 2 || header.dataTypeCode == 3)
     {
-        in.read(reinterpret_cast<char*>(data.data()),
-                static_cast<std::streamsize>(nbytes));
-
-        if (!in)
+        if (static_cast<std::size_t>(end - p) < data.size())
         {
             std::cerr << "Error reading pixel data\n";
             return false;
         }
+
+        for (int y{0}; y < h; ++y, p += rowBytes)
+            storePixels(p, &data[(flip ? h - 1 - y : y) * rowBytes], w, bpp);
     }
     else if (header.dataTypeCode == 10 || header.dataTypeCode == 11)
     {
-        if (!loadRLEData(in))
+        if (!decodeRLE(p, end, flip))
         {
             std::cerr << "Error reading RLE data\n";
             return false;
@@ -134,13 +189,6 @@ bool TGAImage::readTGAFile(const std::filesystem::path& filename)
         return false;
     }
 
-    if (bpp >= 3)
-        for (std::size_t i{0}; i + (bpp - 1) < data.size(); i += bpp)
-            std::swap(data[i], data[i + 2]);
-
-    if (!(header.imageDescriptor & 0x20))
-        flipVertically();
-
     if (header.imageDescriptor & 0x10)
         flipHorizontally();
 
@@ -151,6 +199,9 @@ bool TGAImage::readTGAFile(const std::filesystem::path& filename)
 bool TGAImage::writeTGAFile(const std::filesystem::path& filename,
                             const bool vflip, const bool rle) const
 {
+    std::vector<std::uint8_t> bytes;
+    encodeTGA(bytes, vflip, rle);
+
     std::ofstream out(filename, std::ios::binary);
 
     if (!out)
@@ -159,6 +210,22 @@ bool TGAImage::writeTGAFile(const std::filesystem::path& filename,
         return false;
     }
 
+    out.write(reinterpret_cast<const char*>(bytes.data()),
+              static_cast<std::streamsize>(bytes.size()));
+
+    if (!out)
+    {
+        std::cerr << "Error writing TGA data\n";
+        return false;
+    }
+
+    return true;
+}
+
+void TGAImage::encodeTGA(std::vector<std::uint8_t>& out, const bool vflip,
+                         const bool rle, const bool serial) const
+{
+    PROFILE_SCOPE(TgaEncode);
     TGAHeader header{};
     header.bitsPerPixel = static_cast<std::uint8_t>(bpp << 3);
     header.width = static_cast<std::uint16_t>(w);
@@ -166,118 +233,30 @@ bool TGAImage::writeTGAFile(const std::filesystem::path& filename,
     header.dataTypeCode = (bpp == GRAYSCALE ? (rle ? 11 : 3) : (rle ? 10 : 2));
     header.imageDescriptor = vflip ? 0x00 : 0x20;
 
-    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.resize(sizeof(header));
+    std::memcpy(out.data(), &header, sizeof(header));
 
-    if (!out)
+    if (!rle)
     {
-        std::cerr << "Error writing TGA header\n";
-        return false;
+        out.resize(sizeof(header) + data.size());
+        storePixels(data.data(), out.data() + sizeof(header),
+                    data.size() / bpp, bpp);
     }
-
-    if (!rle)
+    else if (serial)
     {
-        const std::size_t rowBytes{static_cast<std::size_t>(w) * bpp};
-
-        if (bpp == GRAYSCALE)
-        {
-            out.write(reinterpret_cast<const char*>(data.data()),
-                      static_cast<std::streamsize>(data.size()));
-
-            if (!out)
-            {
-                std::cerr << "Error writing pixels\n";
-                return false;
-            }
-        }
-        else
-        {
-            std::vector<std::uint8_t> row(rowBytes);
-
-            if (bpp == 3)
-            {
-                for (int y{0}; y < h; ++y)
-                {
-                    const std::size_t base =
-                        static_cast<std::size_t>(y) * rowBytes;
-
-                    for (int x{0}; x < w; ++x)
-                    {
-                        const std::size_t s =
-                            base + static_cast<std::size_t>(x) * 3;
-                        const std::size_t d = static_cast<std::size_t>(x) * 3;
-                        row[d] = data[s + 2];
-                        row[d + 1] = data[s + 1];
-                        row[d + 2] = data[s];
-                    }
-
-                    out.write(reinterpret_cast<const char*>(row.data()),
-                              static_cast<std::streamsize>(rowBytes));
-
-                    if (!out)
-                    {
-                        std::cerr << "Error writing pixels\n";
-                        return false;
-                    }
-                }
-            }
-            else
-            {
-                for (int y{0}; y < h; ++y)
-                {
-                    const std::size_t base{static_cast<std::size_t>(y) *
-                                           rowBytes};
-
-                    for (int x{0}; x < w; ++x)
-                    {
-                        const std::size_t s{base +
-                                            static_cast<std::size_t>(x) * 4};
-                        const std::size_t d{static_cast<std::size_t>(x) * 4};
-                        row[d] = data[s + 2];
-                        row[d + 1] = data[s + 1];
-                        row[d + 2] = data[s + 0];
-                        row[d + 3] = data[s + 3];
-                    }
-
-                    out.write(reinterpret_cast<const char*>(row.data()),
-                              static_cast<std::streamsize>(rowBytes));
-
-                    if (!out)
-                    {
-                        std::cerr << "Error writing pixels\n";
-                        return false;
-                    }
-                }
-            }
-        }
+        encodeRLESerial(out);
     }
     else
     {
-        if (!unloadRLEData(out))
-        {
-            std::cerr << "Error writing RLE data\n";
-            return false;
-        }
+        encodeRLE(out);
     }
 
-    static constexpr std::uint8_t developerAreaRef[4]{0, 0, 0, 0};
-    static constexpr std::uint8_t extensionAreaRef[4]{0, 0, 0, 0};
-    static constexpr std::uint8_t footer[18]{'T', 'R', 'U', 'E', 'V', 'I',
-                                             'S', 'I', 'O', 'N', '-', 'X',
-                                             'F', 'I', 'L', 'E', '.', '\0'};
-
-    out.write(reinterpret_cast<const char*>(developerAreaRef),
-              sizeof(developerAreaRef));
-    out.write(reinterpret_cast<const char*>(extensionAreaRef),
-              sizeof(extensionAreaRef));
-    out.write(reinterpret_cast<const char*>(footer), sizeof(footer));
-
-    if (!out)
-    {
-        std::cerr << "Error writing TGA footer\n";
-        return false;
-    }
+    // Developer and extension area references, then the signature.
+    static constexpr std::uint8_t footer[26]{
+        0,   0,   0,   0,   0,   0,   0,   0,   'T', 'R', 'U', 'E', 'V',
+        'I', 'S', 'I', 'O', 'N', '-', 'X', 'F', 'I', 'L', 'E', '.', '\0'};
 
-    return true;
+    out.insert(out.end(), std::begin(footer), std::end(footer));
 }
 
 void TGAImage::flipHorizontally()
@@ -325,89 +304,187 @@ void TGAImage::flipVertically()
     }
 }
 
-bool TGAImage::loadRLEData(std::ifstream& in)
+bool TGAImage::decodeRLE(const std::uint8_t* p, const std::uint8_t* end,
+                         const bool flip)
 {
     const std::size_t BPP{static_cast<std::size_t>(bpp)};
-    const std::size_t pixelCount{static_cast<std::size_t>(w) *
-                                 static_cast<std::size_t>(h)};
-    std::size_t curPix{0};
-    std::size_t curByte{0};
-
-    while (curPix < pixelCount)
+    const std::size_t width{static_cast<std::size_t>(w)};
+    const std::size_t height{static_cast<std::size_t>(h)};
+    std::size_t remaining{width * height};
+    std::size_t y{0};
+    std::size_t x{0};
+
+    // Packets run across rows, so each is split at the row ends; a row of
+    // the file goes to its final row of the image.
+    while (remaining)
     {
-        std::uint8_t chunkHeader{0};
-
-        if (!in.read(reinterpret_cast<char*>(&chunkHeader), 1))
+        if (p == end)
         {
             std::cerr << "Error reading RLE chunk header\n";
             return false;
         }
 
-        if (chunkHeader < 128)
+        const std::uint8_t chunkHeader{*p++};
+        const bool run{chunkHeader >= 128};
+        std::size_t count{(chunkHeader & 0x7fu) + 1};
+
+        if ((run ? BPP : count * BPP) > static_cast<std::size_t>(end - p))
         {
-            const std::size_t count{static_cast<std::size_t>(chunkHeader) + 1};
+            std::cerr << (run ? "Error reading RLE seed pixel\n"
+                              : "Error reading raw RLE pixel\n");
+            return false;
+        }
 
-            for (std::size_t i{0}; i < count; ++i)
-            {
-                if (!in.read(reinterpret_cast<char*>(data.data() + curByte),
-                             static_cast<std::streamsize>(BPP)))
-                {
-                    std::cerr << "Error reading raw RLE pixel\n";
-                    return false;
-                }
-
-                curByte += static_cast<std::size_t>(bpp);
-
-                if (++curPix > pixelCount)
-                {
-                    std::cerr << "Too many pixels (raw)\n";
-                    return false;
-                }
-            }
+        if (count > remaining)
+        {
+            std::cerr << (run ? "Too many pixels (rle)\n"
+                              : "Too many pixels (raw)\n");
+            return false;
         }
-        else
+
+        remaining -= count;
+
+        while (count)
         {
-            std::size_t count{static_cast<std::size_t>(chunkHeader) - 127};
-            std::uint8_t px[4];
+            const std::size_t n{std::min(count, width - x)};
+            std::uint8_t* const d{
+                &data[((flip ? height - 1 - y : y) * width + x) * BPP]};
 
-            if (!in.read(reinterpret_cast<char*>(px),
-                         static_cast<std::streamsize>(BPP)))
+            if (run)
             {
-                std::cerr << "Error reading RLE seed pixel\n";
-                return false;
+                fillPixels(p, d, n, BPP);
             }
-
-            for (std::size_t i{0}; i < count; ++i)
+            else
             {
-                for (std::size_t t{0}; t < BPP; ++t) data[curByte + t] = px[t];
+                storePixels(p, d, n, BPP);
+                p += n * BPP;
+            }
 
-                curByte += BPP;
+            count -= n;
+            x += n;
 
-                if (++curPix > pixelCount)
-                {
-                    std::cerr << "Too many pixels (rle)\n";
-                    return false;
-                }
+            if (x == width)
+            {
+                x = 0;
+                ++y;
             }
         }
+
+        if (run)
+            p += BPP;
     }
 
     return true;
 }
 
-bool TGAImage::unloadRLEData(std::ofstream& out) const
+// First index in [from, to) whose bit in mask differs from the low bit of
+// flip, or to when there is none.
+static std::size_t findBit(const std::uint64_t* mask, std::size_t from,
+                           const std::size_t to, const std::uint64_t flip)
+{
+    while (from < to)
+    {
+        const std::uint64_t word{(mask[from / 64] ^ flip) >> (from % 64)};
+
+        if (word)
+            return std::min<std::size_t>(to, from + std::countr_zero(word));
+
+        from += 64 - from % 64;
+    }
+
+    return to;
+}
+
+void TGAImage::encodeRLE(std::vector<std::uint8_t>& out) const
+{
+    // Pixels per band of the equality scan, a whole number of mask words.
+    constexpr std::size_t kBandPixels{1 << 14};
+    constexpr std::size_t kMaxChunkLen{128};
+    static const PixelRunScan scan{pixelRunScan(detectIsa())};
+    const std::size_t BPP{static_cast<std::size_t>(bpp)};
+    const std::size_t nPixels{static_cast<std::size_t>(w) *
+                              static_cast<std::size_t>(h)};
+    const std::ptrdiff_t nBands{
+        static_cast<std::ptrdiff_t>((nPixels + kBandPixels - 1) / kBandPixels)};
+    std::vector<std::uint64_t> equal((nPixels + 63) / 64, 0);
+
+#pragma omp parallel for schedule(static)
+
+    for (std::ptrdiff_t b = 0; b < nBands; ++b)
+    {
+        const std::size_t first{static_cast<std::size_t>(b) * kBandPixels};
+        const std::size_t last{std::min(first + kBandPixels, nPixels - 1)};
+
+        if (first < last)
+            scan(data.data(), nPixels, bpp, first, last, equal.data());
+    }
+
+    // The pixel-at-a-time encoder compares a pixel with the next one only
+    // while the chunk can still grow: pixels up to 128 from its start and
+    // short of the last pixel. A run extends over the equal pairs; a raw
+    // chunk stops short of the first equal pair, or takes all 128 pixels.
+    struct Chunk
+    {
+        std::size_t pixel;
+        std::size_t offset;
+        std::uint8_t header;
+    };
+
+    std::vector<Chunk> chunks;
+    std::size_t size{0};
+
+    for (std::size_t cur{0}; cur < nPixels;)
+    {
+        const std::size_t limit{std::min(cur + kMaxChunkLen, nPixels)};
+        std::size_t len{0};
+
+        if (cur + 1 < nPixels && (equal[cur / 64] >> (cur % 64) & 1))
+        {
+            len = findBit(equal.data(), cur + 1, limit - 1, ~0ull) + 1 - cur;
+            chunks.push_back({cur, size, static_cast<std::uint8_t>(len + 127)});
+            size += 1 + BPP;
+        }
+        else
+        {
+            const std::size_t pair{
+                findBit(equal.data(), cur + 1, limit - 1, 0)};
+
+            len = (pair < limit - 1 ? pair : limit) - cur;
+            chunks.push_back({cur, size, static_cast<std::uint8_t>(len - 1)});
+            size += 1 + len * BPP;
+        }
+
+        cur += len;
+    }
+
+    const std::size_t base{out.size()};
+    const std::ptrdiff_t nChunks{static_cast<std::ptrdiff_t>(chunks.size())};
+    out.resize(base + size);
+
+#pragma omp parallel for schedule(static)
+
+    for (std::ptrdiff_t c = 0; c < nChunks; ++c)
+    {
+        const Chunk& chunk{chunks[c]};
+        std::uint8_t* const d{out.data() + base + chunk.offset};
+
+        d[0] = chunk.header;
+        storePixels(&data[chunk.pixel * BPP], d + 1,
+                    chunk.header < 128 ? chunk.header + 1u : 1u, BPP);
+    }
+}
+
+void TGAImage::encodeRLESerial(std::vector<std::uint8_t>& out) const
 {
-    constexpr std::uint8_t kMaxChunkLen{128};
+    constexpr std::size_t kMaxChunkLen{128};
     const std::size_t BPP{static_cast<std::size_t>(bpp)};
     const std::size_t nPixels{static_cast<std::size_t>(w) *
                               static_cast<std::size_t>(h)};
-    std::array<std::uint8_t, kMaxChunkLen * 4> buf{};
     std::size_t curPix{0};
 
     while (curPix < nPixels)
     {
-        const std::size_t chunkStartPix{curPix};
-        const std::size_t chunkStartByte{chunkStartPix * BPP};
+        const std::size_t chunkStartByte{curPix * BPP};
         std::size_t probeByte{chunkStartByte};
         std::size_t runLen{1};
         bool raw{true};
@@ -433,91 +510,14 @@ bool TGAImage::unloadRLEData(std::ofstream& out) const
             ++runLen;
         }
 
-        out.put(raw ? static_cast<char>(runLen - 1)
-                    : static_cast<char>(runLen + 127));
+        out.push_back(static_cast<std::uint8_t>(raw ? runLen - 1
+                                                    : runLen + 127));
 
-        if (!out)
-            return false;
-
-        if (raw)
-        {
-            const std::size_t start{chunkStartByte};
-
-            if (BPP == 1)
-            {
-                const std::size_t bytes{runLen * BPP};
-
-                if (!out.write(reinterpret_cast<const char*>(&data[start]),
-                               static_cast<std::streamsize>(bytes)))
-                    return false;
-            }
-            else if (BPP == 3)
-            {
-                std::size_t s{start};
-                std::size_t d{0};
-
-                for (std::size_t i{0}; i < runLen; ++i, s += 3, d += 3)
-                {
-                    buf[d] = data[s + 2];
-                    buf[d + 1] = data[s + 1];
-                    buf[d + 2] = data[s];
-                }
-
-                const std::size_t bytes{runLen * 3};
-
-                if (!out.write(reinterpret_cast<const char*>(buf.data()),
-                               static_cast<std::streamsize>(bytes)))
-                    return false;
-            }
-            else
-            {
-                std::size_t s{start};
-                std::size_t d{0};
-
-                for (std::size_t i{0}; i < runLen; ++i, s += 4, d += 4)
-                {
-                    buf[d] = data[s + 2];
-                    buf[d + 1] = data[s + 1];
-                    buf[d + 2] = data[s];
-                    buf[d + 3] = data[s + 3];
-                }
-
-                const std::size_t bytes{runLen * 4};
-
-                if (!out.write(reinterpret_cast<const char*>(buf.data()),
-                               static_cast<std::streamsize>(bytes)))
-                    return false;
-            }
-        }
-        else
-        {
-            const std::size_t s{chunkStartByte};
-
-            if (BPP == 1)
-            {
-                if (!out.write(reinterpret_cast<const char*>(&data[s]), 1))
-                    return false;
-            }
-            else if (BPP == 3)
-            {
-                const std::uint8_t triplet[3]{data[s + 2], data[s + 1],
-                                              data[s]};
-
-                if (!out.write(reinterpret_cast<const char*>(triplet), 3))
-                    return false;
-            }
-            else
-            {
-                const std::uint8_t quad[4]{data[s + 2], data[s + 1], data[s],
-                                           data[s + 3]};
-
-                if (!out.write(reinterpret_cast<const char*>(quad), 4))
-                    return false;
-            }
-        }
+        const std::size_t count{raw ? runLen : 1};
+        const std::size_t end{out.size()};
+        out.resize(end + count * BPP);
+        storePixels(&data[chunkStartByte], out.data() + end, count, BPP);
 
         curPix += runLen;
     }
-
-    return true;
 }
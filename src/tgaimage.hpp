@@ -4,6 +4,7 @@
 #include <cstdint>
 #include <filesystem>
 #include <fstream>
+#include <span>
 #include <vector>
 
 static_assert(true);
@@ -61,10 +62,27 @@ struct TGAImage
     int width() const noexcept { return w; }
     int height() const noexcept { return h; }
 
+    // Memory-maps the file and decodes it with decodeTGA.
     bool readTGAFile(const std::filesystem::path& filename);
+
+    // Decodes a whole TGA file held in memory straight into the image's row
+    // order and RGB(A) byte order: raw rows and RLE packets are copied with
+    // the channel swap to their final rows, and runs are filled with wide
+    // copies. Truncated or overlong data is rejected without reading past
+    // the end of file.
+    bool decodeTGA(const std::span<const std::uint8_t> file);
     bool writeTGAFile(const std::filesystem::path& filename,
                       const bool vflip = true, const bool rle = true) const;
 
+    // Encodes the whole file into out, which is then written with a single
+    // write. The RLE data is built in three passes: a SIMD scan marks which
+    // pixels equal the next one in parallel bands, a serial pass over that
+    // mask places the chunks exactly where the original pixel-at-a-time
+    // encoder did, and the chunks are then filled in parallel. serial runs
+    // that original encoder instead; both produce the same bytes.
+    void encodeTGA(std::vector<std::uint8_t>& out, const bool vflip = true,
+                   const bool rle = true, const bool serial = false) const;
+
     void flipHorizontally();
     void flipVertically();
 
@@ -74,6 +92,8 @@ struct TGAImage
     std::uint8_t bpp{0};
     std::vector<std::uint8_t> data{};
 
-    bool loadRLEData(std::ifstream& in);
-    bool unloadRLEData(std::ofstream& out) const;
+    bool decodeRLE(const std::uint8_t* p, const std::uint8_t* end,
+                   const bool flip);
+    void encodeRLE(std::vector<std::uint8_t>& out) const;
+    void encodeRLESerial(std::vector<std::uint8_t>& out) const;
 };
@@ -0,0 +1,105 @@
+#include "visibility.hpp"
+
+#include <algorithm>
+
+#include "assembly.hpp"
+
+VisibilityBuffer::VisibilityBuffer(Framebuffer& framebuffer)
+    : framebuffer(framebuffer), target(framebuffer.addTarget(none))
+{
+}
+
+void VisibilityBuffer::begin()
+{
+    instances.clear();
+    initVisibility(framebuffer.target(target), 0);
+}
+
+void VisibilityBuffer::addInstance(const IShader& shader,
+                                   const std::span<const vec4> clip,
+                                   const std::span<const std::uint32_t> indices)
+{
+    const std::uint32_t base{
+        instances.empty() ? 0
+                          : static_cast<std::uint32_t>(
+                                instances.back().base +
+                                instances.back().indices.size() / 3)};
+
+    instances.push_back(
+        {base, &shader, std::vector<vec4>(clip.begin(), clip.end()), indices});
+    initVisibility(framebuffer.target(target), base);
+}
+
+void VisibilityBuffer::resolve(const int nthreads)
+{
+    const int width{framebuffer.width()};
+    const int height{framebuffer.height()};
+    const std::uint32_t* const ids{framebuffer.target(target)};
+
+    initVisibility(nullptr, 0);
+
+#pragma omp parallel for schedule(dynamic) num_threads(nthreads)
+
+    for (int y = 0; y < height; ++y)
+    {
+        // Neighbouring pixels mostly share a triangle, so its setup is only
+        // recomputed when the ID changes along the row. A triangle clipped
+        // at the near plane is set up piece by piece again, and each pixel
+        // is shaded through the piece that covers it.
+        std::uint32_t last{none};
+        const Instance* instance{nullptr};
+        TriangleSetup pieces[2];
+        int npieces{0};
+        AssemblyStats stats;
+
+        for (int x{0}; x < width; ++x)
+        {
+            const std::uint32_t id{ids[x + y * width]};
+
+            if (id == none)
+                continue;
+
+            if (id != last)
+            {
+                instance = &*(std::upper_bound(
+                                  instances.begin(), instances.end(), id,
+                                  [](const std::uint32_t id, const Instance& i)
+                                  { return id < i.base; }) -
+                              1);
+
+                const int face{static_cast<int>(id - instance->base)};
+                const std::uint32_t* index{&instance->indices[face * 3]};
+                const Triangle clip{instance->clip[index[0]],
+                                    instance->clip[index[1]],
+                                    instance->clip[index[2]]};
+
+                npieces =
+                    setupClipped(face, clip, width, height, pieces, stats);
+                last = id;
+            }
+
+            const TriangleSetup* setup{&pieces[0]};
+            dvec3 bc{setup->bc0 + setup->bcdy * y + setup->bcdx * x};
+
+            if (npieces == 2)
+            {
+                const dvec3 other{pieces[1].bc0 + pieces[1].bcdy * y +
+                                  pieces[1].bcdx * x};
+
+                if (std::min({other.x, other.y, other.z}) * pieces[1].scale >
+                    std::min({bc.x, bc.y, bc.z}) * setup->scale)
+                {
+                    setup = &pieces[1];
+                    bc = other;
+                }
+            }
+
+            auto [discard, color]{instance->shader->fragment(
+                setup->face,
+                static_cast<vec3>(shadingBarycentrics(*setup, bc)))};
+
+            if (!discard)
+                framebuffer.set(x, y, color);
+        }
+    }
+}
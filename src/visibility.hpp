@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "gl.hpp"
+
+// Frame-wide buffer of 32-bit triangle IDs, kept as an extra target of the
+// framebuffer it shades into. Rasterization only writes depth and the ID of
+// the nearest triangle per pixel; resolve() then reconstructs each pixel's
+// barycentrics from its triangle and runs the shader once per visible pixel.
+// An ID is an instance's base plus the face index within it.
+class VisibilityBuffer
+{
+   public:
+    static constexpr std::uint32_t none{~0u};
+
+    explicit VisibilityBuffer(Framebuffer& framebuffer);
+
+    // Drops all instances and binds the ID target to the rasterizer. IDs are
+    // reset to none by Framebuffer::clear().
+    void begin();
+
+    // Registers the next mesh to be rasterized. Its clip-space vertices are
+    // copied; its index buffer and shader must outlive resolve().
+    void addInstance(const IShader& shader, std::span<const vec4> clip,
+                     std::span<const std::uint32_t> indices);
+
+    // Unbinds the buffer and shades every covered pixel.
+    void resolve(const int nthreads);
+
+   private:
+    struct Instance
+    {
+        std::uint32_t base;
+        const IShader* shader;
+        std::vector<vec4> clip;
+        std::span<const std::uint32_t> indices;
+    };
+
+    Framebuffer& framebuffer;
+    int target;
+    std::vector<Instance> instances{};
+};